@@ -1,10 +1,13 @@
 #pragma once
 #include "COMMON.h"
 
+#include <array>
 #include <atomic>
 #include <limits>
 #include <cmath>
 #include <functional>
+#include <utility>
+#include <vector>
 
 #include "MCP230XX.h"
 #include "MCP3XXX.h"
@@ -18,6 +21,12 @@
 #define BOARD_MEM (8 * 1024)
 #define BOARD_PRT (configMAX_PRIORITIES - 1)
 
+#define CONV_MEM (4 * 1024)
+#define CONV_PRT (13) // above the webserver, below LwIP
+
+#define EXPD_MEM (3 * 1024)
+#define EXPD_PRT (CONV_PRT + 1) // I2C writes are short, ahead of the converter
+
 //
 
 enum class Input : uint8_t
@@ -61,12 +70,139 @@ namespace Board
 	// Gains settings: R=1Ohm; Min: 1mA=>1V, Med: 10mA=>1V, Max: 100mA=>1V
 	constexpr int32_t curr_gains[4] = {5, 1000, 100, 10}; // gains of instr.amp | min range => max gain
 
+	// Sync point statistics of a run, latencies in log2 buckets of microseconds:
+	// bucket 0 holds 0us, bucket b holds [2^(b-1), 2^b) us, the last one also everything above
+	struct RunStats
+	{
+		static constexpr size_t hist_bins = 16;
+
+		std::array<uint32_t, hist_bins> wake_hist = {};				// alarm -> task resume, syncs the task blocked on
+		std::array<uint32_t, hist_bins> spin_hist = {};				// busy-wait end -> task resume, syncs that were spun to
+		std::array<uint32_t, hist_bins> io_hist = {};				// sync point -> I/O start, every sync
+		std::array<uint32_t, Interpreter::cs_lut_sz> overruns = {}; // syncs reached after their time, by opcode
+		uint32_t scan_overruns = 0;									// scan frames reached after their time
+		uint32_t syncs = 0;
+		uint32_t armed_late = 0; // DELAYs that armed a time already in the past
+		uint32_t max_lag_us = 0;
+		size_t worst_instr = -1; // index of the instruction with max_lag_us
+		uint64_t run_time_us = 0;
+	};
+
+	// Free-running acquisition, a frame of all inputs in mask every period_us, without the interpreter.
+	// Frame: payload, then time bytes; payload holds the inputs in order as 4-byte values,
+	// or for Raw as 12-bit codes packed LSB first (input k at bit 12k), zero-padded to whole bytes.
+	enum class ScanFormat : uint8_t
+	{
+		Float, // V, A
+		Milli, // mV, mA as int32
+		Micro, // uV, uA as int32
+		Raw,
+	};
+
+	// Triggered scan: frames go into an on-device ring, only windows of pre + post frames around
+	// a trigger are sent, the trigger frame being the first post one
+	enum class TriggerSource : uint8_t
+	{
+		None, // free-running
+		Analog,
+		Digital,
+	};
+
+	enum class TriggerEdge : uint8_t
+	{
+		Rising,
+		Falling,
+		Both,
+	};
+
+	struct ScanTrigger
+	{
+		TriggerSource source = TriggerSource::None;
+		TriggerEdge edge = TriggerEdge::Rising;
+		uint8_t port = 1;	  // Analog: input, must be scanned, Digital: digital input
+		float level = 0;	  // Analog: V or A
+		float hysteresis = 0; // Analog: the signal has to leave the level by this much to re-arm
+		uint32_t pre = 0;	  // frames before the trigger
+		uint32_t post = 1;	  // frames from the trigger on, at least 1
+		uint32_t captures = 1; // windows, 0: until the stream is closed
+	};
+
+	constexpr size_t trigger_max_frames = 4096; // pre + post
+
+	struct ScanConfig
+	{
+		uint8_t mask = 0; // bit 0 = In1
+		std::array<AnIn_Range, 4> ranges = {AnIn_Range::Max, AnIn_Range::Max, AnIn_Range::Max, AnIn_Range::Max};
+		uint32_t period_us = 1000;
+		uint32_t oversample = 1; // readings averaged per input and frame
+		ScanFormat format = ScanFormat::Float;
+		uint64_t frames = 0; // 0: until the stream is closed, ignored with a trigger
+		ScanTrigger trigger;
+	};
+
+	// Logic analyzer, the digital inputs sampled in a tight loop timed on CPU cycles, only transitions are sent.
+	// Record: LEB128 varint of (cycles since the previous record << 4 | state of the inputs in mask, DI1 = bit 0),
+	// the first one holds the initial state after 0 cycles, the last one the state at the end
+	struct LogicConfig
+	{
+		uint8_t mask = 0b1111;		// inputs whose changes are recorded
+		uint32_t period_cycles = 0; // between samples, 0: as fast as the GPIO reads go
+		uint64_t duration_us = 0;	// 0: until the stream is closed
+		uint32_t transitions = 0;	// 0: no limit
+	};
+
+	struct LogicResult
+	{
+		uint32_t records = 0; // incl. the first and last one
+		uint64_t cycles = 0;
+		bool overflow = false; // stopped early, the Communicator had no space
+	};
+
+	// Calibration, actual = gain * nominal + offset (V, A): of inputs per range, of outputs per port
+	struct CalPoint
+	{
+		float gain = 1;
+		float offset = 0;
+	};
+
+	struct Calibration
+	{
+		std::array<std::array<CalPoint, 4>, 4> in = {}; // [input - 1][range]
+		std::array<CalPoint, 2> out = {};				 // [output - 1]
+	};
+
 	esp_err_t init();
 	esp_err_t deinit();
 
 	esp_err_t move_config(Interpreter::Program &, std::vector<Generator> &);
+	esp_err_t move_program(Interpreter::Program &); // keeps current generators
+	size_t generator_count();
 
 	esp_err_t give_sem_emergency();
 
+	esp_err_t arm_scan(const ScanConfig &); // the next run scans instead of running the program
+	esp_err_t disarm_scan(); // and the logic capture
+
+	esp_err_t arm_logic(const LogicConfig &);  // the next run captures transitions instead of running the program
+	esp_err_t get_logic_result(LogicResult &); // of the last capture, fails while running
+	uint32_t cycles_per_us();
+	size_t scan_frame_bytes(const ScanConfig &); // payload only
+
+	esp_err_t benchmark(std::vector<std::pair<Interpreter::OPCode, uint32_t>> &, std::vector<std::pair<const char *, uint32_t>> &, size_t); // per opcode, per listed instruction form
+	const Interpreter::CostModel &get_cost_model(); // nominal until benchmark() succeeds
+	esp_err_t get_run_stats(RunStats &);			 // of the last run, fails while running
+
+	// Raw stream: phy = (code - raw_code_offset()) * raw_scale(in, rng) + raw_offset(in, rng), in V or A
+	float raw_scale(Input, AnIn_Range);
+	float raw_offset(Input, AnIn_Range);
+	int32_t raw_code_offset();
+
+	esp_err_t get_calibration(Calibration &);
+	esp_err_t set_calibration(const Calibration &); // folded into the conversion coefficients and DAC tables
+	esp_err_t save_calibration();					// to NVS, init() loads it
+	// Reads the input with a known reference applied; the next capture of the same input and range
+	// with another reference sets its gain and offset from both. nominal: the reading without calibration
+	esp_err_t calibrate_capture(Input, AnIn_Range, float, float &, bool &);
+
 	esp_err_t test();
 };
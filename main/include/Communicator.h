@@ -19,9 +19,22 @@ namespace Communicator
 	esp_err_t deinit();
 
 	esp_err_t time_settings(size_t);
+	esp_err_t raw_settings(bool);
+	bool is_raw();
 
 	bool write_4bytes(const int64_t &, const uint32_t &);
 
+	// Raw mode: 12-bit codes packed in pairs, 3 bytes (a[7:0], b[3:0]a[11:8], b[11:4]) then both times
+	bool write_code(const int64_t &, uint16_t);
+	bool flush_codes(); // pads an unpaired code with a zero one
+	uint32_t code_count();
+
+	// Scan mode: whole frame payload then time
+	bool write_frame(const int64_t &, etl::span<const char>);
+
+	// Logic mode: encoded blocks as they are
+	bool write_bytes(etl::span<const char>);
+
 	template <typename T>
 	bool write_data(const int64_t &time, const T &val)
 		requires(sizeof(T) == sizeof(uint32_t))
@@ -35,6 +48,7 @@ namespace Communicator
 
 	bool is_running();
 	bool has_data();
+	size_t available(); // free bytes, a write may get less at the wrap
 
 	void start_running();
 	void ask_to_exit();
@@ -0,0 +1,79 @@
+#pragma once
+#include "Board.h"
+
+#include <array>
+#include <type_traits>
+
+// Nominal conversion of ADC sums into V or A, without calibration; the tables are built at compile time
+
+namespace Board
+{
+	constexpr int32_t halfrangein = MCP3204::ref / 2;
+
+	constexpr size_t an_in_rng_num = 4;
+	constexpr size_t an_in_scale_num = static_cast<size_t>(Input::In4); // inputs
+
+	// Conversion of a sum of cnt readings, phy = sum * ratio * num / den / cnt, per input and range
+	struct InScale
+	{
+		int32_t num = 0;
+		int32_t den = 1;
+		float num_f = 0;
+		float den_f = 1;
+	};
+
+	constexpr std::array<std::array<InScale, an_in_rng_num>, an_in_scale_num> in_scales = []()
+	{
+		std::array<std::array<InScale, an_in_rng_num>, an_in_scale_num> ret = {};
+		for (size_t in = 0; in < an_in_scale_num; ++in)
+			for (size_t rng = 0; rng < an_in_rng_num; ++rng)
+			{
+				InScale &sc = ret[in][rng];
+				if (static_cast<Input>(in + 1) == Input::In4) // current
+				{
+					sc.num = ItoU_input;
+					sc.den = curr_gains[rng];
+				}
+				else // voltage
+				{
+					sc.num = volt_divs[rng];
+					sc.den = 1;
+				}
+				sc.num_f = sc.num;
+				sc.den_f = sc.den;
+			}
+		return ret;
+	}();
+
+	// Same results as converting with the range looked up per sample, the operations are kept in order
+	template <typename num_t, int32_t mul = 1>
+	inline num_t bin_to_phy_nominal(Input in, AnIn_Range rng, int32_t sum, int32_t cnt)
+	{
+		constexpr num_t ratio = u_ref * mul / halfrangein;
+
+		if (in == Input::None || in == Input::Inv) [[unlikely]]
+			return 0;
+
+		const InScale &sc = in_scales[static_cast<size_t>(in) - 1][static_cast<size_t>(rng)];
+
+		if constexpr (std::is_floating_point_v<num_t>)
+		{
+			num_t val = sum * ratio * sc.num_f;
+			if (sc.den != 1)
+				val /= sc.den_f;
+			if (cnt != 1)
+				val /= cnt;
+			return val;
+		}
+		else // integer ratio, nested truncating divisions equal a single one
+		{
+			int64_t val = int64_t(sum) * (ratio * sc.num);
+			int64_t div = int64_t(sc.den) * cnt;
+			if (div == 1) [[likely]]
+				return val;
+			if (val == static_cast<int32_t>(val) && div == static_cast<int32_t>(div)) [[likely]] // no libgcc 64-bit division
+				return static_cast<int32_t>(val) / static_cast<int32_t>(div);
+			return val / div;
+		}
+	}
+}
@@ -4,6 +4,8 @@
 #include <vector>
 
 #include <cmath>
+#include <limits>
+#include <numeric>
 #include <numbers>
 #include <utility>
 
@@ -101,6 +103,15 @@ protected:
 public:
 	using index_t = int32_t;
 
+	// Least common multiple of periods, 0 if either is aperiodic or it does not fit
+	static index_t period_lcm(index_t a, index_t b)
+	{
+		if (a <= 0 || b <= 0)
+			return 0;
+		int64_t l = std::lcm<int64_t>(a, b);
+		return (l <= std::numeric_limits<index_t>::max()) ? l : 0;
+	}
+
 	Signal() = default;
 	virtual ~Signal() = default;
 
@@ -112,9 +123,18 @@ public:
 	{
 		return SignalType::Virtual;
 	}
+	// For i >= lead(): get(i) == get(i + period()), period 0 means aperiodic
+	virtual index_t period() const
+	{
+		return 1;
+	}
+	virtual index_t lead() const
+	{
+		return 0;
+	}
 
-	friend void to_json(json &j, const Signal &o) {}
-	friend void from_json(const json &j, Signal &o) {}
+	friend void to_json(json &, const Signal &) {}
+	friend void from_json(const json &, Signal &) {}
 };
 
 //
@@ -134,8 +154,8 @@ public:
 		return SignalType::Const;
 	}
 
-	friend void to_json(json &j, const SignalConst &o) {}
-	friend void from_json(const json &j, SignalConst &o) {}
+	friend void to_json(json &, const SignalConst &) {}
+	friend void from_json(const json &, SignalConst &) {}
 };
 
 class SignalImpulse : public Signal
@@ -152,9 +172,13 @@ public:
 	{
 		return SignalType::Impulse;
 	}
+	index_t lead() const override
+	{
+		return 1;
+	}
 
-	friend void to_json(json &j, const SignalImpulse &o) {}
-	friend void from_json(const json &j, SignalImpulse &o) {}
+	friend void to_json(json &, const SignalImpulse &) {}
+	friend void from_json(const json &, SignalImpulse &) {}
 };
 
 class SignalSine : public Signal
@@ -175,6 +199,10 @@ public:
 	{
 		return SignalType::Sine;
 	}
+	index_t period() const override
+	{
+		return (T > 0) ? T : 0;
+	}
 
 	NLOHMANN_DEFINE_TYPE_INTRUSIVE(SignalSine, T);
 };
@@ -197,6 +225,10 @@ public:
 	{
 		return SignalType::Square;
 	}
+	index_t period() const override
+	{
+		return (T > 0) ? T : 0;
+	}
 
 	NLOHMANN_DEFINE_TYPE_INTRUSIVE(SignalSquare, T, D);
 };
@@ -230,6 +262,10 @@ public:
 	{
 		return SignalType::Triangle;
 	}
+	index_t period() const override
+	{
+		return (T > 0) ? T : 0;
+	}
 
 	NLOHMANN_DEFINE_TYPE_INTRUSIVE(SignalTriangle, T, P);
 };
@@ -258,6 +294,10 @@ public:
 	{
 		return SignalType::Chirp;
 	}
+	index_t period() const override
+	{
+		return (T > 0) ? T : 0;
+	}
 
 	NLOHMANN_DEFINE_TYPE_INTRUSIVE(SignalChirp, T, FS, FD);
 };
@@ -287,6 +327,10 @@ public:
 	{
 		return SignalType::ChirpLog;
 	}
+	index_t period() const override
+	{
+		return (T > 0) ? T : 0;
+	}
 
 	NLOHMANN_DEFINE_TYPE_INTRUSIVE(SignalChirpLog, T, FS, FR);
 };
@@ -316,6 +360,17 @@ public:
 	{
 		return SignalType::Delay;
 	}
+	index_t period() const override
+	{
+		return S->period();
+	}
+	index_t lead() const override
+	{
+		int64_t l = int64_t(S->lead()) + D;
+		if (l > std::numeric_limits<index_t>::max())
+			return std::numeric_limits<index_t>::max();
+		return std::max<int64_t>(l, 0);
+	}
 
 	NLOHMANN_DEFINE_TYPE_INTRUSIVE(SignalDelay, D, S);
 };
@@ -339,6 +394,14 @@ public:
 	{
 		return SignalType::Absolute;
 	}
+	index_t period() const override
+	{
+		return S->period();
+	}
+	index_t lead() const override
+	{
+		return S->lead();
+	}
 
 	NLOHMANN_DEFINE_TYPE_INTRUSIVE(SignalAbsolute, S);
 };
@@ -364,6 +427,14 @@ public:
 	{
 		return SignalType::Clamp;
 	}
+	index_t period() const override
+	{
+		return S->period();
+	}
+	index_t lead() const override
+	{
+		return S->lead();
+	}
 
 	NLOHMANN_DEFINE_TYPE_INTRUSIVE(SignalClamp, L, H, S);
 };
@@ -389,6 +460,14 @@ public:
 	{
 		return SignalType::LinearMap;
 	}
+	index_t period() const override
+	{
+		return S->period();
+	}
+	index_t lead() const override
+	{
+		return S->lead();
+	}
 
 	NLOHMANN_DEFINE_TYPE_INTRUSIVE(SignalLinearMap, A, B, S);
 };
@@ -413,6 +492,14 @@ public:
 	{
 		return SignalType::Multiply;
 	}
+	index_t period() const override
+	{
+		return period_lcm(S1->period(), S2->period());
+	}
+	index_t lead() const override
+	{
+		return std::max(S1->lead(), S2->lead());
+	}
 
 	NLOHMANN_DEFINE_TYPE_INTRUSIVE(SignalMultiply, S1, S2);
 };
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <algorithm>
 #include <memory>
 #include <vector>
 #include <utility> //pair
@@ -48,6 +49,22 @@ public:
 		return signals.size();
 	}
 
+	// Same contract as Signal::period() and Signal::lead(), for the sum
+	index_t period() const
+	{
+		index_t ret = 1;
+		for (const auto &s : signals)
+			ret = Signal::period_lcm(ret, s.second->period());
+		return ret;
+	}
+	index_t lead() const
+	{
+		index_t ret = 0;
+		for (const auto &s : signals)
+			ret = std::max(ret, s.second->lead());
+		return ret;
+	}
+
 	friend void to_json(json &j, const Generator &o)
 	{
 		j = json::array();
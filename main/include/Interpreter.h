@@ -1,13 +1,17 @@
 #pragma once
 #include "COMMON.h"
 
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <stack>
 #include <string>
+#include <string_view>
 #include <vector>
 
-#include <memory>
-#include <variant>
-
-#include <functional>
+#include "etl/span.h"
 
 #include "CTOR.h"
 
@@ -22,6 +26,8 @@ namespace Interpreter
 		AIRDF,
 		AIRDM,
 		AIRDU,
+		AIRDB,
+		AIRDC,
 
 		AIEN,
 		AIDIS,
@@ -29,6 +35,8 @@ namespace Interpreter
 
 		AOVAL,
 		AOGEN,
+		AOSTEP,
+		AODUAL,
 
 		DIRD,
 
@@ -37,14 +45,21 @@ namespace Interpreter
 		DORST,
 		DOAND,
 		DOXOR,
+		DOMSK,
 
 		DELAY,
+		DELAYSTEP,
 		GETTM,
 		RSTTM,
 
+		LOOP,
+		END,
+
 		INV = uint8_t(-1),
 	};
 
+	constexpr size_t cs_lut_sz = static_cast<size_t>(OPCode::END) + 1; // count of valid OPCodes
+
 	struct Instruction
 	{
 		OPCode opc = OPCode::NOP;
@@ -63,81 +78,191 @@ namespace Interpreter
 
 	//
 
-	class Loop;
-	using LoopPtr = std::unique_ptr<Loop>;
-	using Statement = std::variant<std::monostate, Instruction, LoopPtr>;
+	struct LoopDesc
+	{
+		uint32_t max_iter = 0;
+		uint32_t begin = 0; // index of LOOP instr
+		uint32_t end = 0;	// index of END instr
+		mutable uint32_t iter = 0;
+	};
 
-	//
+	// Parameters of AOSTEP / DELAYSTEP, the value depends on the iteration of the innermost enclosing loop
+	struct StepDesc
+	{
+		float start = 0;
+		float step = 0;	   // AOSTEP: added per iteration, DELAYSTEP: multiplied per iteration
+		uint32_t loop = 0; // index of the enclosing LoopDesc
+	};
+
+	// AIRDC packs the decimation ratio (low half) and the order of its CIC filter (high half) into arg
+	constexpr uint32_t cic_max_decim = 1024;
+	constexpr uint32_t cic_max_order = 4;
 
-	class Scope
+	constexpr uint32_t cic_arg(uint32_t decim, uint32_t order)
+	{
+		return decim | order << 16;
+	}
+	constexpr uint32_t cic_decim(uint32_t arg)
+	{
+		return arg & 0xFFFF;
+	}
+	constexpr uint32_t cic_order(uint32_t arg)
 	{
-		std::vector<Statement> statements;
-		mutable size_t index = 0;
+		return arg >> 16;
+	}
+	constexpr bool cic_valid(uint32_t arg)
+	{
+		return cic_decim(arg) >= 1 && cic_decim(arg) <= cic_max_decim && cic_order(arg) >= 1 && cic_order(arg) <= cic_max_order;
+	}
 
-	public:
-		DEFAULT_CTOR(Scope);
-		// DEFAULT_CP_CTOR(Scope); // illegal, cant copy vector with uniqueptrs
-		DEFAULT_MV_CTOR(Scope);
+	// AODUAL packs the generator indices for Out1 (low half) and Out2 (high half) into arg
+	constexpr uint32_t dual_max_gen = 0xFFFF;
 
-		InstrPtr getInstr() const;
-		bool finished() const;
-		void reset() const;
-		void restart() const;
+	constexpr uint32_t dual_arg(uint32_t gen1, uint32_t gen2)
+	{
+		return gen1 | gen2 << 16;
+	}
+	constexpr uint32_t dual_gen(uint32_t arg, size_t out) // out: 1 or 2
+	{
+		return (out == 1) ? arg & 0xFFFF : arg >> 16;
+	}
 
-		Instruction &appendInstr(const Instruction & = Instruction());
-		Loop &appendLoop(size_t);
+	// Computed delay in whole microseconds, saturated to uint32
+	inline uint32_t delay_round(float us)
+	{
+		if (!(us < 4294967040.0f)) // largest float below 2^32, also catches inf
+			return UINT32_MAX;
+		return static_cast<uint32_t>(std::lround(us));
+	}
 
-		size_t size() const;
-	};
+	constexpr size_t loop_overhead = sizeof(LoopDesc) + 2 * sizeof(Instruction); // LOOP, END and descriptor
 
 	//
 
-	class Loop
+	// Estimated execution time of instructions, in microseconds
+	struct CostModel
 	{
-		Scope scope;
-		size_t max_iter = 0;
-		mutable size_t iter = 0;
+		std::array<float, cs_lut_sz> base_us = {};
+		float per_rep_us = 0; // each AIRD* repetition
+		float sync_us = 0;	  // wakeup latency of every sync point
+		float spin_us = 0;	  // sync points armed closer than this are busy-waited, without the wakeup latency
+	};
 
-	public:
-		Loop(size_t = 0);
-		~Loop();
-		// DEFAULT_CP_CTOR(Loop)
-		// DEFAULT_MV_CTOR(Loop)
+	struct TimingReport
+	{
+		double run_time_us = 0;	 // predicted, incl. overruns
+		double max_lag_us = 0;	 // worst delay of a sync point behind schedule
+		uint64_t records = 0;	 // produced data records
+		uint64_t overruns = 0;	 // sync points reached late
+		size_t worst_instr = -1; // DELAY with the biggest overrun
+		std::vector<std::string> warnings;
+	};
 
-		InstrPtr getInstr() const;
-		bool finished() const;
+	// Binary program, all little-endian:
+	//   header: magic "IOBP", u16 version, u16 flags (0), u32 instruction count
+	//   count x record: u8 opcode, u8 port, u32 arg (LOOP: iterations, END: 0)
+	//     AOSTEP/DELAYSTEP: arg is float start, followed by a NOP record with float step in arg
+	//   trailer: u32 CRC-32 (IEEE 802.3) of header and records
+	constexpr uint32_t bin_magic = 0x50424F49; // "IOBP"
+	constexpr uint16_t bin_version = 5;
+	constexpr size_t bin_header_sz = 12;
+	constexpr size_t bin_record_sz = 6;
+	constexpr size_t bin_trailer_sz = 4;
 
-		void reset() const;
-		void restart() const;
+	// Fills buf with up to len bytes, returns count read, 0 on end, <0 on error
+	using ReadCb = std::function<int(char *, size_t)>;
 
-		Scope &getScope();
-	};
+	// Asked at loop back-edges and by poll_stop(), true ends the running program
+	using StopCb = bool (*)();
 
 	//
 
 	class Program
 	{
-		Scope scope;
+		// Flat bytecode, LOOP/END hold the index of their LoopDesc in arg.u, AOSTEP/DELAYSTEP of their StepDesc
+		// Scratch while building (parse, load, optimize), empty once packed
+		std::vector<Instruction> code;
+		std::vector<LoopDesc> loops;
+		std::vector<StepDesc> steps;
+
+		// Packed program: code followed by loop and step descriptors, in a single allocation
+		std::unique_ptr<std::byte[]> arena;
+		etl::span<const Instruction> prg_code;
+		etl::span<const LoopDesc> prg_loops;
+		etl::span<const StepDesc> prg_steps;
+
+		mutable size_t pc = 0;
+		mutable StopCb stop_cb = nullptr;
 		bool prgValid = true;
 
+		void clear();
+		void pack();
+		void unpack();
+
+		bool load_code(const ReadCb &, size_t, std::vector<std::string> &);
+
+		bool optimize_loops();
+		void optimize_peephole();
+		void relink();
+
+		struct TimingState;
+		void analyze_range(size_t, size_t, const CostModel &, TimingState &, TimingReport &) const;
+
 	public:
+		// Incremental text parser, statements may span fed chunks
+		class Parser
+		{
+			Program &prg;
+			std::vector<std::string> &err;
+			std::stack<size_t, std::vector<size_t>> scopes; // indices of open LoopDescs
+			std::string carry;								// unterminated statement
+			size_t line = 0;
+			bool overlong = false;
+
+			void flush();
+			void statement(std::string_view);
+
+		public:
+			Parser(Program &, std::vector<std::string> &);
+			void feed(std::string_view);
+			bool finish();
+		};
+
 		DEFAULT_CTOR(Program);
 		// DEFAULT_CP_CTOR(Program);
-		DEFAULT_MV_CTOR(Program);
+		Program(Program &&);
+		Program &operator=(Program &&); // the moved-from one is left empty, its spans must not outlive the arena
 
-		bool parse(const std::string &, std::vector<std::string> &);
+		bool parse(std::string_view, std::vector<std::string> &);
+		bool load(const ReadCb &, size_t, std::vector<std::string> &);
+		void encode(std::string &) const;
+		void optimize();
+		bool analyze(const CostModel &, size_t, bool, TimingReport &, std::vector<std::string> &);
 
 		InstrPtr getInstr() const;
-		void reset() const;
+		size_t index_of(InstrPtr) const; // of an instruction returned by getInstr()
+		void reset(StopCb = nullptr) const;
+		bool poll_stop() const; // if stop_cb asks to, getInstr() returns nullinstr from now on
+		float step_value(const Instruction &) const; // current value of AOSTEP / DELAYSTEP
 
 		size_t size() const;
+		etl::span<const Instruction> instructions() const; // packed code, for scans
+		size_t loop_count() const;
+		size_t bytes() const; // of the packed storage
 
 		bool isValid() const;
 	};
 
 	//////
 
-	using ParseCb = std::function<bool(const std::vector<std::string> &, Instruction &)>; // in args, inout instr
+	constexpr size_t max_stmt_len = 32;
+	constexpr size_t max_args = 3;
+
+	constexpr size_t unroll_max = 16; // max instructions produced by unrolling a single loop
+
+	using ParseArgs = std::array<std::string_view, max_args>;
+	using ParseCb = bool (*)(const ParseArgs &, Instruction &); // in args, inout instr
+	using CheckCb = bool (*)(const Instruction &);				// validates decoded binary instr
 
 	struct InstrLUTRow
 	{
@@ -147,7 +272,9 @@ namespace Interpreter
 		const char *descstr;
 		size_t argcnt;
 		ParseCb parser;
+		CheckCb checker;
 	};
 
-	extern const std::vector<InstrLUTRow> CS_LUT;
+	// One row per OPCode, in OPCode order
+	extern const std::array<InstrLUTRow, cs_lut_sz> CS_LUT;
 };
\ No newline at end of file
@@ -1,16 +1,21 @@
 #pragma once
 
-#define CB_HELP(COND) [](const std::vector<std::string> &args, Instruction &cs) { return (COND); }
+#define CB_HELP(COND) []([[maybe_unused]] const ParseArgs &args, [[maybe_unused]] Instruction &cs) { return (COND); }
 #define READ_IP (try_parse_integer(args[0], cs.port) && (cs.port >= 1 && cs.port <= 4))
 #define READ_OP (try_parse_integer(args[0], cs.port) && (cs.port >= 1 && cs.port <= 2))
 #define READ_DO (try_parse_integer(args[0], cs.arg.u, 0) && (cs.arg.u <= 0b1111))
 
+#define CK_HELP(COND) []([[maybe_unused]] const Instruction &cs) { return (COND); }
+#define CHECK_IP (cs.port >= 1 && cs.port <= 4)
+#define CHECK_OP (cs.port >= 1 && cs.port <= 2)
+#define CHECK_DO (cs.arg.u <= 0b1111)
+
 #define SNTX_IP "<port (1|2|3|4)>"
 #define SNTX_OP "<port (1|2)>"
 #define SNTX_NO "<no args>"
 #define SNTX_DO "<state (4-bit hex/oct/dec int)>"
 
-const std::vector<InstrLUTRow> CS_LUT = {
+constexpr std::array<InstrLUTRow, cs_lut_sz> CS_LUT = {{
 	{
 		OPCode::NOP,
 		"NOP",
@@ -18,31 +23,53 @@ const std::vector<InstrLUTRow> CS_LUT = {
 		"No OPeration - does nothing, does not parse, do not use",
 		0,
 		CB_HELP(false),
+		CK_HELP(false),
 	},
 	//
 	{
 		OPCode::AIRDF,
 		"AIRDF",
-		SNTX_IP " <repetitions>",
+		SNTX_IP " <repetitions (uint32, >0)>",
 		"Analog Input ReaD Float - returns measurement (V, A) as 32-bit float",
 		2,
-		CB_HELP(READ_IP && (try_parse_integer(args[1], cs.arg.u))),
+		CB_HELP(READ_IP && (try_parse_integer(args[1], cs.arg.u) && cs.arg.u >= 1)),
+		CK_HELP(CHECK_IP && cs.arg.u >= 1),
 	},
 	{
 		OPCode::AIRDM,
 		"AIRDM",
-		SNTX_IP " <repetitions>",
+		SNTX_IP " <repetitions (uint32, >0)>",
 		"Analog Input ReaD Milli - returns measurement (mV, mA) as 32-bit int",
 		2,
-		CB_HELP(READ_IP && (try_parse_integer(args[1], cs.arg.u))),
+		CB_HELP(READ_IP && (try_parse_integer(args[1], cs.arg.u) && cs.arg.u >= 1)),
+		CK_HELP(CHECK_IP && cs.arg.u >= 1),
 	},
 	{
 		OPCode::AIRDU,
 		"AIRDU",
-		SNTX_IP " <repetitions>",
+		SNTX_IP " <repetitions (uint32, >0)>",
 		"Analog Input ReaD Micro - returns measurement (uV, uA) as 32-bit int",
 		2,
-		CB_HELP(READ_IP && (try_parse_integer(args[1], cs.arg.u))),
+		CB_HELP(READ_IP && (try_parse_integer(args[1], cs.arg.u) && cs.arg.u >= 1)),
+		CK_HELP(CHECK_IP && cs.arg.u >= 1),
+	},
+	{
+		OPCode::AIRDB,
+		"AIRDB",
+		"<port_mask (4-bit hex/oct/dec int)> <repetitions (uint32, >0)>",
+		"Analog Input ReaD Burst - reads all masked ports interleaved in one queued burst, returns one 32-bit float per port (V, A)",
+		2,
+		CB_HELP((try_parse_integer(args[0], cs.port, 0) && (cs.port >= 1 && cs.port <= 0b1111)) && (try_parse_integer(args[1], cs.arg.u) && cs.arg.u >= 1)),
+		CK_HELP(cs.port >= 1 && cs.port <= 0b1111 && cs.arg.u >= 1),
+	},
+	{
+		OPCode::AIRDC,
+		"AIRDC",
+		SNTX_IP " <decimation (uint32, 1..1024)> <order (1..4)>",
+		"Analog Input ReaD CIC - returns CIC-decimated measurement (V, A) as 32-bit float",
+		3,
+		CB_HELP(READ_IP && try_parse_cic(args[1], args[2], cs.arg.u)),
+		CK_HELP(CHECK_IP && cic_valid(cs.arg.u)),
 	},
 	//
 	{
@@ -52,6 +79,7 @@ const std::vector<InstrLUTRow> CS_LUT = {
 		"Analog Input ENable - turns on input ports connections",
 		0,
 		CB_HELP(true),
+		CK_HELP(true),
 	},
 	{
 		OPCode::AIDIS,
@@ -60,6 +88,7 @@ const std::vector<InstrLUTRow> CS_LUT = {
 		"Analog Input DISable - turns off input ports connections",
 		0,
 		CB_HELP(true),
+		CK_HELP(true),
 	},
 	{
 		OPCode::AIRNG,
@@ -68,6 +97,7 @@ const std::vector<InstrLUTRow> CS_LUT = {
 		"Analog Input RaNGe - sets the range of port (selects divider/multiplier gain)",
 		2,
 		CB_HELP(READ_IP && (try_parse_range(args[1], cs.arg.u))),
+		CK_HELP(CHECK_IP && cs.arg.u <= 3),
 	},
 	//
 	{
@@ -77,6 +107,7 @@ const std::vector<InstrLUTRow> CS_LUT = {
 		"Analog Output VALue - outputs value to port",
 		2,
 		CB_HELP(READ_OP && (try_parse_floating_point(args[1], cs.arg.f) && std::isfinite(cs.arg.f))),
+		CK_HELP(CHECK_OP && std::isfinite(cs.arg.f)),
 	},
 	{
 		OPCode::AOGEN,
@@ -85,6 +116,25 @@ const std::vector<InstrLUTRow> CS_LUT = {
 		"Analog Output GENerator - outputs value created by the chosen Generator to port",
 		2,
 		CB_HELP(READ_OP && (try_parse_integer(args[1], cs.arg.u))),
+		CK_HELP(CHECK_OP),
+	},
+	{
+		OPCode::AOSTEP,
+		"AOSTEP",
+		SNTX_OP " <start (float)> <step (float)>",
+		"Analog Output STEP - outputs start + step * iteration of the enclosing LOOP to port",
+		3,
+		nullptr,
+		CK_HELP(CHECK_OP),
+	},
+	{
+		OPCode::AODUAL,
+		"AODUAL",
+		"<generator_idx_1 (uint16)> <generator_idx_2 (uint16)>",
+		"Analog Output DUAL generator - outputs values of the two Generators to ports 1 and 2 back-to-back, AOGEN pairs on the same tick become this",
+		2,
+		CB_HELP(try_parse_dual(args[0], args[1], cs.arg.u)),
+		CK_HELP(true),
 	},
 	//
 	{
@@ -94,6 +144,7 @@ const std::vector<InstrLUTRow> CS_LUT = {
 		"Digital Inputs ReaD - returns state of pins as 32-bit uint",
 		0,
 		CB_HELP(true),
+		CK_HELP(true),
 	},
 	//
 	{
@@ -103,6 +154,7 @@ const std::vector<InstrLUTRow> CS_LUT = {
 		"Digital Outputs WRite - directly writes the state to the pins",
 		1,
 		CB_HELP(READ_DO),
+		CK_HELP(CHECK_DO),
 	},
 	{
 		OPCode::DOSET,
@@ -111,6 +163,7 @@ const std::vector<InstrLUTRow> CS_LUT = {
 		"Digital Outputs SET - turns ON pins corresponding to set bits (bitwise OR)",
 		1,
 		CB_HELP(READ_DO),
+		CK_HELP(CHECK_DO),
 	},
 	{
 		OPCode::DORST,
@@ -119,6 +172,7 @@ const std::vector<InstrLUTRow> CS_LUT = {
 		"Digital Outputs ReSeT - turns OFF pins corresponding to set bits",
 		1,
 		CB_HELP(READ_DO),
+		CK_HELP(CHECK_DO),
 	},
 	{
 		OPCode::DOAND,
@@ -127,6 +181,7 @@ const std::vector<InstrLUTRow> CS_LUT = {
 		"Digital Outputs AND - turns OFF pins corresponding to unset bits (bitwise AND)",
 		1,
 		CB_HELP(READ_DO),
+		CK_HELP(CHECK_DO),
 	},
 	{
 		OPCode::DOXOR,
@@ -135,6 +190,16 @@ const std::vector<InstrLUTRow> CS_LUT = {
 		"Digital Outputs XOR - performs a bitwise eXclusive OR operation",
 		1,
 		CB_HELP(READ_DO),
+		CK_HELP(CHECK_DO),
+	},
+	{
+		OPCode::DOMSK,
+		"DOMSK",
+		"<keep_mask (4-bit int)> <xor_mask (4-bit int)>",
+		"Digital Outputs MaSKed write - keeps pins from first mask, then XORs with second (state = state & keep ^ xor)",
+		2,
+		CB_HELP((try_parse_integer(args[0], cs.port, 0) && (cs.port <= 0b1111)) && (try_parse_integer(args[1], cs.arg.u, 0) && (cs.arg.u <= 0b1111))),
+		CK_HELP(cs.port <= 0b1111 && CHECK_DO),
 	},
 	//
 	{
@@ -144,6 +209,16 @@ const std::vector<InstrLUTRow> CS_LUT = {
 		"DELAY - sets the next synchronization timestamp based on last timestamp",
 		1,
 		CB_HELP(try_parse_integer(args[0], cs.arg.u)),
+		CK_HELP(true),
+	},
+	{
+		OPCode::DELAYSTEP,
+		"DELAYSTEP",
+		"<start (float, us)> <factor (float, >0)>",
+		"DELAY STEP - like DELAY, lasts start * factor ^ iteration of the enclosing LOOP",
+		2,
+		nullptr,
+		CK_HELP(true),
 	},
 	{
 		OPCode::GETTM,
@@ -152,6 +227,7 @@ const std::vector<InstrLUTRow> CS_LUT = {
 		"GET TiMe - sets the next synchronization timestamp to now",
 		0,
 		CB_HELP(true),
+		CK_HELP(true),
 	},
 	{
 		OPCode::RSTTM,
@@ -160,31 +236,39 @@ const std::vector<InstrLUTRow> CS_LUT = {
 		"ReSeT TiMe - sets timer to zero",
 		0,
 		CB_HELP(true),
+		CK_HELP(true),
 	},
 	//
 	{
-		OPCode::INV,
+		OPCode::LOOP,
 		"LOOP",
 		"<iterations (uint32)>",
 		"LOOP - opens a Scope between itself and matching END and repeats the code specified number of times",
 		1,
 		nullptr,
+		CK_HELP(true),
 	},
 	{
-		OPCode::INV,
+		OPCode::END,
 		"END",
 		SNTX_NO,
 		"END - closes current Scope",
 		0,
 		nullptr,
+		CK_HELP(true),
 	},
-};
+}};
 
 #undef CB_HELP
 #undef READ_IP
 #undef READ_OP
 #undef READ_DO
 
+#undef CK_HELP
+#undef CHECK_IP
+#undef CHECK_OP
+#undef CHECK_DO
+
 #undef SNTX_IP
 #undef SNTX_OP
 #undef SNTX_NO
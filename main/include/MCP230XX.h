@@ -19,6 +19,12 @@ public:
 	uint8_t gpio = 0;
 
 private:
+	// Shadows of the device registers, writes of the value already held are skipped
+	uint8_t olat = 0;
+	uint8_t iodir = 0;
+	bool olat_known = false; // the device may keep its state over a reset of the ESP, unknown until written
+	bool iodir_known = false;
+
 	enum class Register : uint8_t
 	{
 		IODIR = 0x00,
@@ -46,6 +52,8 @@ public:
 
 	esp_err_t init(bool out = false)
 	{
+		invalidate();
+
 		if (out)
 			ESP_RETURN_ON_ERROR(
 				set_direction(0),
@@ -85,7 +93,20 @@ public:
 
 	esp_err_t set_pins()
 	{
-		return write_reg(Register::OLAT, gpio);
+		if (olat_known && olat == gpio)
+			return ESP_OK;
+
+		esp_err_t ret = write_reg(Register::OLAT, gpio);
+		if (ret != ESP_OK) [[unlikely]]
+		{
+			olat_known = false; // the device may hold either value now
+			ESP_LOGE(TAG, "Failed to write_reg!");
+			return ret;
+		}
+
+		olat = gpio;
+		olat_known = true;
+		return ESP_OK;
 	}
 	esp_err_t get_pins()
 	{
@@ -97,7 +118,20 @@ public:
 	// When a bit is set, the corresponding pin becomes an input. When a bit is clear, the corresponding pin becomes an output.
 	esp_err_t set_direction(uint8_t val)
 	{
-		return write_reg(Register::IODIR, val);
+		if (iodir_known && iodir == val)
+			return ESP_OK;
+
+		esp_err_t ret = write_reg(Register::IODIR, val);
+		if (ret != ESP_OK) [[unlikely]]
+		{
+			iodir_known = false; // the device may hold either value now
+			ESP_LOGE(TAG, "Failed to write_reg!");
+			return ret;
+		}
+
+		iodir = val;
+		iodir_known = true;
+		return ESP_OK;
 	}
 	// esp_err_t get_direction(uint8_t &val)
 	// {
@@ -198,6 +232,13 @@ public:
 	// 	return read_reg(Register::OLAT, val);
 	// }
 
+	// Forgets the shadows, the next writes go to the device
+	void invalidate()
+	{
+		olat_known = false;
+		iodir_known = false;
+	}
+
 	// Single bit manipulation
 	void set_bit(uint8_t b)
 	{
@@ -1,6 +1,8 @@
 #ifndef MCP3XXX_H
 #define MCP3XXX_H
 
+#include <algorithm>
+#include <array>
 #include <type_traits>
 
 #include <esp_log.h>
@@ -62,10 +64,11 @@ private:
 	spi_host_device_t spi_host;
 	gpio_num_t cs_gpio;
 	int clk_hz;
+	int queue_sz;
 	spi_device_handle_t spi_hdl;
 
 public:
-	MCP3xxx(spi_host_device_t sh, gpio_num_t csg, int chz = 1'000'000) : spi_host(sh), cs_gpio(csg), clk_hz(chz)
+	MCP3xxx(spi_host_device_t sh, gpio_num_t csg, int chz = 1'000'000, int qsz = 1) : spi_host(sh), cs_gpio(csg), clk_hz(chz), queue_sz(qsz)
 	{
 		ESP_LOGI(TAG, "Constructed with host: %d, pin: %d", spi_host, cs_gpio);
 	}
@@ -87,7 +90,7 @@ public:
 			.input_delay_ns = 0,
 			.spics_io_num = cs_gpio,
 			.flags = SPI_DEVICE_HALFDUPLEX, // SPI_DEVICE_NO_DUMMY - dummy is required and used as the conversion time delay
-			.queue_size = 1,
+			.queue_size = queue_sz,
 			.pre_cb = NULL,
 			.post_cb = NULL,
 		};
@@ -158,6 +161,101 @@ public:
 		return ret;
 	}
 
+	// Runs cnt polling transactions alternating between the two slots, done(trx) consumes a finished one
+	// while the next is already on the bus - parsing overlaps the conversion instead of following it.
+	template <typename Done>
+	esp_err_t pipeline(std::array<spi_transaction_t, 2> &slots, size_t cnt, Done &&done) const
+	{
+		if (cnt == 0) [[unlikely]]
+			return ESP_OK;
+
+		ESP_RETURN_ON_ERROR(
+			send_trx(slots[0]),
+			TAG, "Failed to send_trx!");
+
+		for (size_t i = 1; i < cnt; ++i)
+		{
+			ESP_RETURN_ON_ERROR(
+				recv_trx(),
+				TAG, "Failed to recv_trx!");
+
+			ESP_RETURN_ON_ERROR(
+				send_trx(slots[i & 1]),
+				TAG, "Failed to send_trx!");
+
+			done(slots[(i - 1) & 1]);
+		}
+
+		ESP_RETURN_ON_ERROR(
+			recv_trx(),
+			TAG, "Failed to recv_trx!");
+
+		done(slots[(cnt - 1) & 1]);
+
+		return ESP_OK;
+	}
+
+	// Queued (interrupt/DMA driven), must not overlap with polling transactions
+
+	inline esp_err_t queue_trx(spi_transaction_t &trx, TickType_t timeout = portMAX_DELAY) const
+	{
+		assert(spi_hdl);
+
+		ESP_RETURN_ON_ERROR(
+			spi_device_queue_trans(spi_hdl, &trx, timeout),
+			TAG, "Error in spi_device_queue_trans!");
+
+		return ESP_OK;
+	}
+
+	inline esp_err_t collect_trx(spi_transaction_t *&trx, TickType_t timeout = portMAX_DELAY) const
+	{
+		assert(spi_hdl);
+
+		ESP_RETURN_ON_ERROR(
+			spi_device_get_trans_result(spi_hdl, &trx, timeout),
+			TAG, "Error in spi_device_get_trans_result!");
+
+		return ESP_OK;
+	}
+
+	// Streams cnt transactions through the ring, keeping up to queue_sz of them in flight.
+	// prep(i, trx) fills the i-th transaction before it is queued, done(i, trx) consumes it once finished, in order.
+	template <size_t N, typename Prep, typename Done>
+	esp_err_t burst(std::array<spi_transaction_t, N> &ring, size_t cnt, Prep &&prep, Done &&done) const
+	{
+		const size_t depth = std::min<size_t>(N, queue_sz);
+		size_t queued = 0;
+		size_t finished = 0;
+		esp_err_t ret = ESP_OK;
+
+		while (finished < cnt)
+		{
+			while (ret == ESP_OK && queued < cnt && queued - finished < depth)
+			{
+				spi_transaction_t &trx = ring[queued % depth];
+				prep(queued, trx);
+				ret = queue_trx(trx);
+				if (ret == ESP_OK)
+					++queued;
+			}
+
+			if (finished == queued) // nothing in flight, failed to queue
+				break;
+
+			spi_transaction_t *trx;
+			esp_err_t r = collect_trx(trx);
+			if (r != ESP_OK) // driver state unknown, give up on the rest
+				return r;
+
+			if (ret == ESP_OK)
+				done(finished, *trx);
+			++finished;
+		}
+
+		return ret;
+	}
+
 	inline out_t parse_trx(const spi_transaction_t &trx) const
 	{
 		uout_t out = SPI_SWAP_DATA_RX(*reinterpret_cast<const uint32_t *>(trx.rx_data), B);
@@ -0,0 +1,302 @@
+#pragma once
+
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "nlohmann/json.hpp"
+
+#include "Generator.h"
+#include "Interpreter.h"
+
+// Consumes the settings JSON as SAX events, so the body never exists as a DOM.
+// "task" is fed to the program parser as it arrives, either as one string or as an array of strings
+// (concatenated, so statements may span elements - then only one element is buffered at a time).
+// Each element of "generators" is built as a small DOM and converted right away.
+class SettingsSax
+{
+	static constexpr const char *const TAG = "SettingsSax";
+
+	using json_t = nlohmann::json;
+	using string_t = json_t::string_t;
+	using binary_t = json_t::binary_t;
+	using number_integer_t = json_t::number_integer_t;
+	using number_unsigned_t = json_t::number_unsigned_t;
+	using number_float_t = json_t::number_float_t;
+	using dom_parser_t = nlohmann::detail::json_sax_dom_parser<json_t>;
+
+	enum class Field : uint8_t
+	{
+		None,
+		Generators,
+		Task,
+		Strict,
+	};
+
+public:
+	Interpreter::Program &program;
+	std::vector<Generator> &generators;
+	std::vector<std::string> &errors;
+
+	size_t instr_parsed = 0;
+	bool strict = false;
+
+private:
+	size_t depth = 0; // nesting level of the current event, root object is 1
+	Field field = Field::None;
+
+	std::optional<Interpreter::Program::Parser> parser;
+
+	bool gen_array = false; // inside "generators": [...]
+	json_t gen_json;
+	std::optional<dom_parser_t> gen_dom;
+	size_t gen_depth = 0; // nesting inside the current generator
+
+public:
+	SettingsSax(Interpreter::Program &p, std::vector<Generator> &g, std::vector<std::string> &e) : program(p), generators(g), errors(e) {}
+	~SettingsSax() = default;
+
+private:
+	// Events for the current "generators" element go to the DOM parser
+	bool in_generator() const
+	{
+		return gen_array && depth >= 2;
+	}
+
+	void generator_begin()
+	{
+		gen_json = nullptr;
+		gen_dom.emplace(gen_json, true);
+	}
+
+	void generator_end()
+	{
+		gen_dom.reset();
+		try
+		{
+			Generator g = gen_json.get<Generator>();
+			generators.push_back(std::move(g));
+		}
+		catch (json_t::exception &e)
+		{
+			generators.emplace_back();
+			errors.push_back("Generator #" + std::to_string(generators.size() - 1) + " failed to parse: " + e.what());
+			ESP_LOGW(TAG, "Generator failed to parse: %s", e.what());
+		}
+		gen_json = nullptr;
+	}
+
+	template <typename F>
+	bool generator_scalar(F &&f)
+	{
+		if (gen_depth == 0)
+			generator_begin();
+		bool ret = f(*gen_dom);
+		if (gen_depth == 0)
+			generator_end();
+		return ret;
+	}
+
+	// Scalar value of a top-level field
+	template <typename T>
+	bool value(const T &val)
+	{
+		if (depth != 1 && !(parser && depth == 2))
+			return true; // ignored
+
+		switch (field)
+		{
+		case Field::Task:
+			if constexpr (std::is_same_v<T, string_t>)
+			{
+				if (depth == 1)
+					parser.emplace(program, errors);
+				parser->feed(val);
+				if (depth == 1)
+					task_end();
+			}
+			else if (depth == 1)
+				errors.push_back("\"task\" is not a string!");
+			else
+				errors.push_back("\"task\" element is not a string!");
+			break;
+
+		case Field::Strict:
+			if constexpr (std::is_same_v<T, bool>)
+				strict = val;
+			else
+				errors.push_back("\"strict\" is not a boolean!");
+			break;
+
+		case Field::Generators:
+			errors.push_back("\"generators\" is not an array!");
+			break;
+
+		default:
+			break;
+		}
+		return true;
+	}
+
+	void task_end()
+	{
+		parser->finish();
+		parser.reset();
+		instr_parsed = program.size();
+	}
+
+public:
+	bool null()
+	{
+		if (in_generator())
+			return generator_scalar([](dom_parser_t &d)
+									{ return d.null(); });
+		return value(nullptr);
+	}
+	bool boolean(bool val)
+	{
+		if (in_generator())
+			return generator_scalar([val](dom_parser_t &d)
+									{ return d.boolean(val); });
+		return value(val);
+	}
+	bool number_integer(number_integer_t val)
+	{
+		if (in_generator())
+			return generator_scalar([val](dom_parser_t &d)
+									{ return d.number_integer(val); });
+		return value(val);
+	}
+	bool number_unsigned(number_unsigned_t val)
+	{
+		if (in_generator())
+			return generator_scalar([val](dom_parser_t &d)
+									{ return d.number_unsigned(val); });
+		return value(val);
+	}
+	bool number_float(number_float_t val, const string_t &s)
+	{
+		if (in_generator())
+			return generator_scalar([val, &s](dom_parser_t &d)
+									{ return d.number_float(val, s); });
+		return value(val);
+	}
+	bool string(string_t &val)
+	{
+		if (in_generator())
+			return generator_scalar([&val](dom_parser_t &d)
+									{ return d.string(val); });
+		bool ret = value(val);
+		val.clear();
+		val.shrink_to_fit(); // do not keep the task text around
+		return ret;
+	}
+	bool binary(binary_t &val)
+	{
+		if (in_generator())
+			return generator_scalar([&val](dom_parser_t &d)
+									{ return d.binary(val); });
+		return value(val);
+	}
+
+	bool start_object(size_t elements)
+	{
+		if (in_generator())
+		{
+			if (gen_depth++ == 0)
+				generator_begin();
+			++depth;
+			return gen_dom->start_object(elements);
+		}
+		if (depth == 1)
+			value(json_t::object_t());
+		else if (depth == 2 && parser)
+			errors.push_back("\"task\" element is not a string!");
+		++depth;
+		return true;
+	}
+	bool key(string_t &val)
+	{
+		if (in_generator())
+			return gen_dom->key(val);
+		if (depth == 1)
+		{
+			if (val == "generators")
+				field = Field::Generators;
+			else if (val == "task")
+				field = Field::Task;
+			else if (val == "strict")
+				field = Field::Strict;
+			else
+				field = Field::None;
+		}
+		return true;
+	}
+	bool end_object()
+	{
+		--depth;
+		if (in_generator())
+		{
+			bool ret = gen_dom->end_object();
+			if (--gen_depth == 0)
+				generator_end();
+			return ret;
+		}
+		return true;
+	}
+
+	bool start_array(size_t elements)
+	{
+		if (in_generator())
+		{
+			if (gen_depth++ == 0)
+				generator_begin();
+			++depth;
+			return gen_dom->start_array(elements);
+		}
+		if (depth == 1)
+		{
+			if (field == Field::Task)
+				parser.emplace(program, errors);
+			else if (field == Field::Generators)
+			{
+				generators.clear();
+				gen_array = true;
+			}
+			else
+				value(json_t::array_t());
+		}
+		else if (depth == 2 && parser)
+			errors.push_back("\"task\" element is not a string!");
+		++depth;
+		return true;
+	}
+	bool end_array()
+	{
+		--depth;
+		if (in_generator())
+		{
+			bool ret = gen_dom->end_array();
+			if (--gen_depth == 0)
+				generator_end();
+			return ret;
+		}
+		if (depth == 1 && parser)
+			task_end();
+		if (depth == 1)
+			gen_array = false;
+		return true;
+	}
+
+	bool parse_error(size_t pos, const std::string &, const nlohmann::detail::exception &e)
+	{
+		ESP_LOGW(TAG, "JSON error at %u: %s", pos, e.what());
+		errors.push_back("JSON is invalid!");
+		parser.reset();
+		gen_dom.reset();
+		program = Interpreter::Program(); // nothing half-parsed gets through
+		generators.clear();
+		instr_parsed = 0;
+		return false;
+	}
+};
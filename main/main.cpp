@@ -10,7 +10,7 @@
 #include <driver/gpio.h>
 #include <driver/spi_master.h>
 
-// #include <nvs_flash.h>
+#include <nvs_flash.h>
 
 #include "i2c_manager.h"
 #include "wifi.h"
@@ -58,7 +58,7 @@ void spi_init()
 
 	spi_bus_initialize(SPI2_HOST, &bus2_cfg, SPI_DMA_DISABLED);
 
-	spi_bus_initialize(SPI3_HOST, &bus3_cfg, SPI_DMA_DISABLED);
+	spi_bus_initialize(SPI3_HOST, &bus3_cfg, SPI_DMA_CH_AUTO); // ADC bursts are queued
 }
 
 //
@@ -71,14 +71,14 @@ extern "C" void app_main(void)
 	// ESP_ERROR_CHECK(gpio_install_isr_service(0));
 	// ESP_LOGI(TAG, "GPIO_ISR  init done");
 
-	// esp_err_t ret = nvs_flash_init();
-	// if (ret == ESP_ERR_NVS_NO_FREE_PAGES || ret == ESP_ERR_NVS_NEW_VERSION_FOUND)
-	// {
-	// 	ESP_ERROR_CHECK(nvs_flash_erase());
-	// 	ret = nvs_flash_init();
-	// }
-	// ESP_ERROR_CHECK(ret);
-	// ESP_LOGI(TAG, "NVS_FLASH init done");
+	esp_err_t ret = nvs_flash_init(); // calibration
+	if (ret == ESP_ERR_NVS_NO_FREE_PAGES || ret == ESP_ERR_NVS_NEW_VERSION_FOUND)
+	{
+		ESP_ERROR_CHECK(nvs_flash_erase());
+		ret = nvs_flash_init();
+	}
+	ESP_ERROR_CHECK(ret);
+	ESP_LOGI(TAG, "NVS_FLASH init done");
 
 	vTaskDelay(pdMS_TO_TICKS(100));
 
@@ -1,20 +1,31 @@
 #include "Board.h"
+#include "Conversion.h"
 
+#include <algorithm>
 #include <limits>
 #include <cmath>
+#include <numeric>
+#include <cstring>
 
 #include <atomic>
 #include <mutex>
 
+#include <esp_cpu.h>
+#include <esp_heap_caps.h>
 #include <esp_timer.h>
+#include <nvs.h>
 #include <soc/gpio_reg.h>
 #include <driver/gptimer.h>
 
+#include "etl/queue_spsc_atomic.h"
+
 #include "Communicator.h"
 
 using Interpreter::OPCode;
 
 #define SYNC_USE_NOTIF_NOT_SEM 1
+#define SYNC_COLLECT_STATS 1 // a cycle counter read per sync point, the rest is done when the next one is armed
+#define EXPANDER_ASYNC 1	 // AIEN/AIDIS hand the I2C writes to ExpanderTask, reads wait only for their own expander
 
 namespace Board
 {
@@ -34,7 +45,8 @@ namespace Board
 		MCP23008 expander_a(I2C_NUM_0, 0b000);
 		MCP23008 expander_b(I2C_NUM_0, 0b001);
 
-		MCP3204 adc(SPI3_HOST, GPIO_NUM_5, 2'000'000);
+		constexpr size_t adc_queue_sz = 8; // transactions in flight during bursts
+		MCP3204 adc(SPI3_HOST, GPIO_NUM_5, 2'000'000, adc_queue_sz);
 		MCP4922 dac(SPI2_HOST, GPIO_NUM_15, 20'000'000);
 
 		// STATE MACHINE
@@ -45,6 +57,18 @@ namespace Board
 		std::vector<Generator> generators;
 		Interpreter::Program program;
 
+		// AOGEN sample tables, DAC codes rendered at upload for the (generator, port) pairs the program uses
+		struct GenTable
+		{
+			std::vector<MCP4922::in_t> codes; // samples 0 .. lead + period - 1
+			Generator::index_t lead = 0;
+			Generator::index_t period = 0;
+			bool live = false; // too long or aperiodic, evaluated per sample
+		};
+		constexpr size_t gen_table_budget = 16 * 1024; // bytes, of all tables together
+		constexpr Generator::index_t bench_gen_period = 1000; // samples, of the generators benchmark() installs
+		std::vector<std::array<GenTable, an_out_num>> gen_tables;
+
 		//================================//
 		//            HELPERS             //
 		//================================//
@@ -53,6 +77,13 @@ namespace Board
 		TaskHandle_t execute_task = nullptr;
 		std::mutex data_mutex;
 
+		// benchmark() request, measured by the executor - the alarm ISR notifies only that task
+		std::atomic_bool bench_pending = false;
+		size_t bench_reps = 0;
+		std::vector<std::pair<OPCode, uint32_t>> *bench_res = nullptr;
+		std::vector<std::pair<const char *, uint32_t>> *bench_forms = nullptr;
+		esp_err_t bench_ret = ESP_OK;
+
 		gptimer_handle_t sync_timer = nullptr;
 		gptimer_alarm_config_t sync_alarm_cfg = {};
 
@@ -67,8 +98,18 @@ namespace Board
 		uint64_t &time_sync = sync_alarm_cfg.alarm_count;
 		DRAM_ATTR bool wait_for_sync = false;
 
+#if SYNC_COLLECT_STATS
+		RunStats run_stats;
+		uint32_t sync_ccount = 0;  // cycle count when the last sync point was passed
+		uint64_t sync_target = 0;  // and its time_sync
+		bool sync_waited = false;  // whether the sync point was reached before its time
+		bool sync_passed = false;  // not recorded yet, that is done when the next one is armed
+		Interpreter::InstrPtr sync_instr = nullptr; // whose wait passed it, nullinstr for scan frames
+#endif
+
 		// ADC/DAC TRANSACTIONS
-		std::array<spi_transaction_t, an_in_num> trx_in;
+		std::array<std::array<spi_transaction_t, 2>, an_in_num> trx_in; // two slots each, for pipelining
+		std::array<spi_transaction_t, adc_queue_sz> trx_burst;
 		std::array<spi_transaction_t, an_out_num> trx_out;
 
 		// CONSTANTS
@@ -96,9 +137,169 @@ namespace Board
 			return ret;
 		}();
 
-		// I/O conversion
-		constexpr int32_t halfrangein = MCP3204::ref / 2;
+		// I/O conversion, inputs in Conversion.h
+		static_assert(an_in_scale_num == an_in_num);
 		constexpr int32_t halfrangeout = MCP4922::ref / 2;
+
+		// AIRDC filters, per input; the state carries over between back-to-back reads, so consecutive outputs overlap.
+		// It restarts on another decimation or order, a range change, or a read starting over cic_gap_us after the previous
+		// one (e.g. after a DELAY); after a restart the first order - 1 outputs are still settling.
+		struct CicState
+		{
+			std::array<uint64_t, Interpreter::cic_max_order> integ = {}; // wrap around, the output is exact as long as it fits
+			std::array<uint64_t, Interpreter::cic_max_order> comb = {};	 // previous inputs of the comb stages
+			uint32_t arg = 0;											 // decimation and order the state belongs to
+			AnIn_Range rng = AnIn_Range::OFF;
+			uint32_t end_ccount = 0; // when the last read ended
+		};
+		constexpr int32_t cic_frac = 256;  // outputs are mean codes with 8 fractional bits
+		constexpr uint32_t cic_gap_us = 20; // a read starting later than this after the previous one restarts the filter
+		std::array<CicState, an_in_num> cic_states;
+
+		// CALIBRATION, folded into per input and range coefficients, identity ones keep the nominal path
+		struct InCoef
+		{
+			bool active = false;
+			float scale = 0; // V or A per summed code
+			float offset = 0;
+		};
+
+		struct OutCoef
+		{
+			bool active = false;
+			float inv_gain = 1;
+			float offset = 0;
+		};
+
+		Calibration calibration;
+		std::array<std::array<InCoef, an_in_rng_num>, an_in_num> in_coefs;
+		std::array<OutCoef, an_out_num> out_coefs;
+
+		// Two-point capture in progress
+		struct CalCapture
+		{
+			Input in = Input::None;
+			AnIn_Range rng = AnIn_Range::OFF;
+			float ref = 0;
+			float nominal = 0;
+		};
+		CalCapture cal_capture;
+
+		constexpr uint32_t cal_capture_reps = 1024;
+		constexpr TickType_t cal_settle = pdMS_TO_TICKS(20); // relays
+
+		constexpr const char *const nvs_namespace = "board";
+		constexpr const char *const nvs_cal_key = "cal";
+		constexpr uint32_t nvs_cal_version = 1;
+
+		// PIPELINE, the executor queues raw results, ConvertTask on the other core converts and serializes them
+		enum class RawKind : uint8_t
+		{
+			Value, // val is final
+			Float,
+			Milli,
+			Micro,
+		};
+
+		struct RawRecord
+		{
+			uint64_t time;
+			int32_t val; // sum of cnt ADC readings, or the final value
+			uint32_t cnt;
+			RawKind kind;
+			Input in;
+			AnIn_Range rng; // at the time of reading
+		};
+
+		constexpr size_t raw_queue_len = 512;
+		etl::queue_spsc_atomic<RawRecord, raw_queue_len> raw_queue;
+
+		// SCAN, frames of the free-running acquisition take the same way
+		struct ScanFrame
+		{
+			uint64_t time;
+			std::array<int32_t, an_in_num> sums; // of oversample readings
+		};
+
+		constexpr size_t scan_queue_len = 256;
+		etl::queue_spsc_atomic<ScanFrame, scan_queue_len> scan_queue;
+
+		ScanConfig scan_cfg;
+		bool scan_armed = false; // taken by the next run
+		bool scanning = false;	 // the current run scans
+
+		// LOGIC, transitions are encoded into a block on the stack and copied to the Communicator when it fills up
+		LogicConfig logic_cfg;
+		LogicResult logic_result;
+		bool logic_armed = false; // taken by the next run
+		bool logging = false;	  // the current run captures transitions
+
+		constexpr size_t logic_block = 512;
+		constexpr size_t logic_varint_max = 10;		// bytes of a 64-bit LEB128
+		constexpr uint32_t logic_poll_mask = 0x3FF; // samples between checks of the Communicator
+		constexpr uint64_t logic_flush_us = 10'000; // a partial block waits at most this long
+
+		// TRIGGER, the last pre + post frames of a triggered scan, allocated when armed
+		std::vector<ScanFrame> trig_ring;
+		constexpr size_t trig_chunk = scan_queue_len / 2; // frames queued at once when sending a window
+
+		TaskHandle_t convert_task = nullptr;
+		std::atomic_bool converting = false;	 // a run is producing, poll the queue
+		std::atomic_bool convert_idle = true;	 // ConvertTask waits for a notification
+		std::atomic_bool convert_failed = false; // Communicator buffer was full
+		bool raw_codes = false;					 // Communicator packs 12-bit codes, latched at run start
+
+		// EXPANDERS, steering bytes posted by AIEN/AIDIS, ExpanderTask writes the latest one of each
+		constexpr size_t expander_num = 2; // a: inputs 1-2, b: inputs 3-4
+		TaskHandle_t expander_task = nullptr;
+		std::array<std::atomic_uint8_t, expander_num> expander_want;
+		std::array<std::atomic_uint32_t, expander_num> expander_posted;
+		std::array<std::atomic_uint32_t, expander_num> expander_written;
+		std::atomic_bool expander_failed = false;
+
+		// TIMING, in microseconds; nominal values from bus speeds, refined by benchmark()
+		constexpr uint32_t cpu_mhz = CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ;
+		constexpr Interpreter::CostModel cost_nominal = []()
+		{
+			Interpreter::CostModel ret = {};
+			auto set = [&ret](OPCode opc, float us)
+			{
+				ret.base_us[static_cast<size_t>(opc)] = us;
+			};
+			set(OPCode::AIRDF, 3);	// conversion + buffer write
+			set(OPCode::AIRDM, 3);
+			set(OPCode::AIRDU, 3);
+			set(OPCode::AIRDB, 5);
+			set(OPCode::AIRDC, 5); // + comb and 64-bit normalization
+			set(OPCode::AIEN, 150); // I2C, 400kHz
+			set(OPCode::AIDIS, 150);
+			set(OPCode::AIRNG, 150);
+			set(OPCode::AOVAL, 4); // SPI, 20MHz
+			set(OPCode::AOGEN, 6);
+			set(OPCode::AOSTEP, 5);
+			set(OPCode::AODUAL, 10);
+			set(OPCode::DIRD, 2);
+			set(OPCode::DOWR, 0.3);
+			set(OPCode::DOSET, 0.3);
+			set(OPCode::DORST, 0.3);
+			set(OPCode::DOAND, 0.3);
+			set(OPCode::DOXOR, 0.3);
+			set(OPCode::DOMSK, 0.3);
+			set(OPCode::DELAY, 1);
+			set(OPCode::DELAYSTEP, 3); // powf
+			set(OPCode::GETTM, 2);
+			set(OPCode::RSTTM, 3);
+			ret.per_rep_us = 11; // SPI, 2MHz, 19 bits, parsing overlaps the next conversion
+			ret.sync_us = 10;	 // alarm ISR + task wakeup
+			ret.spin_us = 30;	 // a few wakeups, the CPU is not given away for long
+			return ret;
+		}();
+		Interpreter::CostModel cost_model = cost_nominal;
+
+		// Sync points closer than spin_us when armed are busy-waited on CCOUNT instead of the alarm
+		DRAM_ATTR uint32_t spin_us = cost_nominal.spin_us;
+		DRAM_ATTR uint32_t spin_lead_cycles = cpu_mhz / 2; // timer read latency + half a tick, ends the spin earlier
+		DRAM_ATTR bool sync_spin = false;				   // the current sync point is spun to
 	}
 
 	//================================//
@@ -130,26 +331,16 @@ namespace Board
 	}
 
 	template <typename num_t, int32_t mul = 1>
-	static num_t bin_to_phy(Input in, int32_t sum, int32_t cnt)
+	static num_t bin_to_phy(Input in, AnIn_Range rng, int32_t sum, int32_t cnt)
 	{
-		constexpr num_t ratio = u_ref * mul / halfrangein;
-
 		if (in == Input::None || in == Input::Inv) [[unlikely]]
 			return 0;
 
-		size_t inidx = static_cast<size_t>(in) - 1;
-		size_t rngidx = static_cast<size_t>(an_in_range[inidx]);
-		switch (in)
-		{
-		case Input::In1:
-		case Input::In2:
-		case Input::In3:
-			return sum * ratio * volt_divs[rngidx] / cnt;
-		case Input::In4:
-			return sum * ratio / curr_gains[rngidx] / cnt * ItoU_input;
-		default:
-			return 0;
-		}
+		const InCoef &cf = in_coefs[static_cast<size_t>(in) - 1][static_cast<size_t>(rng)];
+		if (cf.active) [[unlikely]]
+			return static_cast<num_t>((sum * cf.scale / cnt + cf.offset) * mul);
+
+		return bin_to_phy_nominal<num_t, mul>(in, rng, sum, cnt);
 	}
 
 	static MCP4922::in_t phy_to_dac(Output out, float val)
@@ -159,6 +350,10 @@ namespace Board
 		if (out == Output::None || out == Output::Inv) [[unlikely]]
 			return 0;
 
+		const OutCoef &cf = out_coefs[static_cast<size_t>(out) - 1];
+		if (cf.active) [[unlikely]]
+			val = (val - cf.offset) * cf.inv_gain;
+
 		if (out == Output::Out2)
 			val *= UtoI_output;
 
@@ -170,6 +365,139 @@ namespace Board
 		return dac_offset(std::round(val * ratio));
 	}
 
+	// V or A per code, without calibration
+	static float nominal_scale(size_t in, size_t rng)
+	{
+		const InScale &sc = in_scales[in][rng];
+		return u_ref / halfrangein * sc.num / sc.den;
+	}
+
+	static bool calibration_valid(const Calibration &cal)
+	{
+		auto ok = [](const CalPoint &p)
+		{ return std::isfinite(p.gain) && std::isfinite(p.offset) && p.gain > 0; };
+
+		for (const auto &rngs : cal.in)
+			if (!std::all_of(rngs.begin(), rngs.end(), ok))
+				return false;
+		return std::all_of(cal.out.begin(), cal.out.end(), ok);
+	}
+
+	static void calibration_fold()
+	{
+		for (size_t in = 0; in < an_in_num; ++in)
+			for (size_t rng = 0; rng < an_in_rng_num; ++rng)
+			{
+				const CalPoint &p = calibration.in[in][rng];
+				InCoef &cf = in_coefs[in][rng];
+				cf.active = p.gain != 1 || p.offset != 0;
+				cf.scale = nominal_scale(in, rng) * p.gain;
+				cf.offset = p.offset;
+			}
+
+		for (size_t out = 0; out < an_out_num; ++out)
+		{
+			const CalPoint &p = calibration.out[out];
+			OutCoef &cf = out_coefs[out];
+			cf.active = p.gain != 1 || p.offset != 0;
+			cf.inv_gain = 1 / p.gain;
+			cf.offset = p.offset;
+		}
+	}
+
+	static esp_err_t calibration_load()
+	{
+		nvs_handle_t nvs;
+		ESP_RETURN_ON_ERROR(
+			nvs_open(nvs_namespace, NVS_READONLY, &nvs),
+			TAG, "Failed to nvs_open!");
+
+		std::pair<uint32_t, Calibration> blob;
+		size_t len = sizeof(blob);
+		esp_err_t ret = nvs_get_blob(nvs, nvs_cal_key, &blob, &len);
+		nvs_close(nvs);
+
+		ESP_RETURN_ON_ERROR(
+			ret,
+			TAG, "Failed to nvs_get_blob!");
+
+		ESP_RETURN_ON_FALSE(
+			len == sizeof(blob) && blob.first == nvs_cal_version && calibration_valid(blob.second),
+			ESP_ERR_INVALID_VERSION, TAG, "Stored calibration is not usable!");
+
+		calibration = blob.second;
+		return ESP_OK;
+	}
+
+	// Samples 0 .. lead + period - 1 of tab, which already holds the generator's lead and period
+	static void generator_table_fill(GenTable &tab, Generator &gen, Output out)
+	{
+		tab.codes.resize(size_t(tab.lead) + tab.period);
+		for (size_t i = 0; i < tab.codes.size(); ++i)
+			tab.codes[i] = phy_to_dac(out, gen.get(i));
+	}
+
+	// Renders a table for every AOGEN of the program, as long as the budget allows
+	static void generator_tables_render()
+	{
+		gen_tables.clear();
+		gen_tables.resize(generators.size());
+
+		size_t budget = gen_table_budget / sizeof(MCP4922::in_t);
+		size_t used = 0;
+
+		auto render = [&](uint32_t idx, uint8_t port)
+		{
+			if (idx >= generators.size())
+				return;
+
+			GenTable &tab = gen_tables[idx][port - 1];
+			if (!tab.codes.empty() || tab.live)
+				return;
+
+			Generator &gen = generators[idx];
+			Output out = static_cast<Output>(port);
+			tab.period = gen.period();
+			tab.lead = gen.lead();
+			size_t len = size_t(tab.lead) + tab.period;
+
+			if (tab.period <= 0 || len > budget - used || heap_caps_get_largest_free_block(MALLOC_CAP_8BIT) < 2 * len * sizeof(MCP4922::in_t))
+			{
+				tab.live = true;
+				ESP_LOGW(TAG, "Generator %" PRIu32 " on port %" PRIu8 " is evaluated live, period: %" PRIi32 ", lead: %" PRIi32, idx, port, tab.period, tab.lead);
+				return;
+			}
+
+			generator_table_fill(tab, gen, out);
+			used += len;
+		};
+
+		for (const Interpreter::Instruction &ins : program.instructions())
+		{
+			if (ins.opc == OPCode::AOGEN)
+				render(ins.arg.u, ins.port);
+			else if (ins.opc == OPCode::AODUAL)
+				for (uint8_t port = 1; port <= an_out_num; ++port)
+					render(Interpreter::dual_gen(ins.arg.u, port), port);
+		}
+
+		ESP_LOGI(TAG, "Generator tables: %zu of %zu samples", used, budget);
+	}
+
+	static inline MCP4922::in_t generator_code(Output out, uint32_t idx)
+	{
+		if (idx >= generators.size()) [[unlikely]]
+			return phy_to_dac(out, 0);
+
+		Generator::index_t i = time_sync;
+		const GenTable &tab = gen_tables[idx][static_cast<size_t>(out) - 1];
+
+		if (!tab.codes.empty() && i >= 0) [[likely]]
+			return tab.codes[(static_cast<size_t>(i) < tab.codes.size()) ? i : tab.lead + (i - tab.lead) % tab.period];
+
+		return phy_to_dac(out, generators[idx].get(i));
+	}
+
 	//----------------//
 	//    BACKEND     //
 	//----------------//
@@ -186,14 +514,49 @@ namespace Board
 		return ESP_OK;
 	}
 
+	static inline MCP23008 &expander(size_t e)
+	{
+		return e ? expander_b : expander_a;
+	}
+
+	static esp_err_t expander_write(size_t e, uint8_t val)
+	{
+#if EXPANDER_ASYNC
+		ESP_RETURN_ON_FALSE(
+			!expander_failed.load(std::memory_order::relaxed),
+			ESP_FAIL, TAG, "Expander fail - range not applied!");
+		expander_want[e].store(val);
+		expander_posted[e].fetch_add(1);
+		xTaskNotifyGive(expander_task);
+		return ESP_OK;
+#else
+		return expander(e).set_pins(val);
+#endif
+	}
+
+	// Waits until the expanders steering the inputs in mask hold what was posted last, ExpanderTask runs on the other core
+	static esp_err_t expanders_wait(uint32_t mask)
+	{
+#if EXPANDER_ASYNC
+		for (size_t e = 0; e < expander_num; ++e)
+			if (mask & (0b11 << (2 * e)))
+				while (expander_written[e].load() != expander_posted[e].load())
+					;
+		ESP_RETURN_ON_FALSE(
+			!expander_failed.load(),
+			ESP_FAIL, TAG, "Expander fail - range not applied!");
+#endif
+		return ESP_OK;
+	}
+
 	static esp_err_t analog_inputs_disable()
 	{
 		ESP_RETURN_ON_ERROR(
-			expander_a.set_pins(0x00),
-			TAG, "Failed to expander_a.set_pins!");
+			expander_write(0, 0x00),
+			TAG, "Failed to expander_write a!");
 		ESP_RETURN_ON_ERROR(
-			expander_b.set_pins(0x00),
-			TAG, "Failed to expander_a.set_pins!");
+			expander_write(1, 0x00),
+			TAG, "Failed to expander_write b!");
 
 		return ESP_OK;
 	}
@@ -206,32 +569,107 @@ namespace Board
 		// ESP_LOGV(TAG, "AIEN: " BYTE_TO_BINARY_PATTERN " " BYTE_TO_BINARY_PATTERN, BYTE_TO_BINARY(lower), BYTE_TO_BINARY(upper));
 
 		ESP_RETURN_ON_ERROR(
-			expander_a.set_pins(lower),
-			TAG, "Failed to expander_a.set_pins!");
+			expander_write(0, lower),
+			TAG, "Failed to expander_write a!");
+
+		ESP_RETURN_ON_ERROR(
+			expander_write(1, upper),
+			TAG, "Failed to expander_write b!");
+
+		return ESP_OK;
+	}
+
+	// Reads the input reps times, the next conversion runs while the previous one is summed
+	static esp_err_t analog_input_read(Input in, uint32_t reps, int32_t &sum)
+	{
+		if (in == Input::None || in == Input::Inv) [[unlikely]]
+			return ESP_ERR_INVALID_ARG;
+
+		ESP_RETURN_ON_ERROR(
+			expanders_wait(BIT(static_cast<size_t>(in) - 1)),
+			TAG, "Failed to expanders_wait!");
 
+		sum = 0;
 		ESP_RETURN_ON_ERROR(
-			expander_b.set_pins(upper),
-			TAG, "Failed to expander_b.set_pins!");
+			adc.pipeline(
+				trx_in[static_cast<size_t>(in) - 1], reps,
+				[&](const spi_transaction_t &trx)
+				{ sum += adc_offset(adc.parse_trx(trx)); }),
+			TAG, "Failed to ADC pipeline!");
 
 		return ESP_OK;
 	}
 
-	static MCP3204::out_t analog_input_read(Input in, MCP3204::out_t &out)
+	// Feeds decim readings of the input through its CIC filter, out is the filtered mean code * cic_frac
+	static esp_err_t analog_input_cic(Input in, uint32_t arg, int32_t &out)
 	{
 		if (in == Input::None || in == Input::Inv) [[unlikely]]
 			return ESP_ERR_INVALID_ARG;
 
-		spi_transaction_t &trx = trx_in[static_cast<size_t>(in) - 1];
+		const size_t pos = static_cast<size_t>(in) - 1;
+		ESP_RETURN_ON_ERROR(
+			expanders_wait(BIT(pos)),
+			TAG, "Failed to expanders_wait!");
+
+		// readings of another setting, or not contiguous with the previous ones (DELAY, other I/O between), must not mix in
+		CicState &cic = cic_states[pos];
+		if (cic.arg != arg || cic.rng != an_in_range[pos] || esp_cpu_get_cycle_count() - cic.end_ccount > cic_gap_us * cpu_mhz)
+			cic = {.arg = arg, .rng = an_in_range[pos]};
+
+		const uint32_t decim = Interpreter::cic_decim(arg);
+		const uint32_t order = Interpreter::cic_order(arg);
 
 		ESP_RETURN_ON_ERROR(
-			adc.send_trx(trx),
-			TAG, "Failed to ADC send_trx!");
+			adc.pipeline(
+				trx_in[pos], decim,
+				[&](const spi_transaction_t &trx)
+				{
+					uint64_t acc = static_cast<int64_t>(adc_offset(adc.parse_trx(trx)));
+					for (uint32_t s = 0; s < order; ++s)
+						acc = cic.integ[s] += acc;
+				}),
+			TAG, "Failed to ADC pipeline!");
+		cic.end_ccount = esp_cpu_get_cycle_count();
+
+		uint64_t acc = cic.integ[order - 1];
+		uint64_t gain = 1;
+		for (uint32_t s = 0; s < order; ++s)
+		{
+			uint64_t prev = cic.comb[s];
+			cic.comb[s] = acc;
+			acc -= prev;
+			gain *= decim;
+		}
+
+		out = static_cast<int64_t>(acc) * cic_frac / static_cast<int64_t>(gain); // |acc| <= 2^11 * gain <= 2^51
+		return ESP_OK;
+	}
+
+	// Reads all inputs in mask reps times, interleaved, as one queued burst
+	static esp_err_t analog_inputs_burst(uint32_t mask, uint32_t reps, std::array<int32_t, an_in_num> &sums)
+	{
+		std::array<uint8_t, an_in_num> chnls;
+		size_t nch = 0;
+		for (size_t i = 0; i < an_in_num; ++i)
+			if (mask & BIT(i))
+				chnls[nch++] = i;
+
+		sums.fill(0);
+		if (nch == 0) [[unlikely]]
+			return ESP_ERR_INVALID_ARG;
 
 		ESP_RETURN_ON_ERROR(
-			adc.recv_trx(),
-			TAG, "Failed to ADC recv_trx!");
+			expanders_wait(mask),
+			TAG, "Failed to expanders_wait!");
 
-		out = adc.parse_trx(trx);
+		ESP_RETURN_ON_ERROR(
+			adc.burst(
+				trx_burst, size_t(reps) * nch,
+				[&](size_t i, spi_transaction_t &trx)
+				{ trx = trx_in[chnls[i % nch]][0]; },
+				[&](size_t i, const spi_transaction_t &trx)
+				{ sums[chnls[i % nch]] += adc_offset(adc.parse_trx(trx)); }),
+			TAG, "Failed to ADC burst!");
 
 		return ESP_OK;
 	}
@@ -259,6 +697,33 @@ namespace Board
 		return ESP_OK;
 	}
 
+	// Both channels back-to-back, the values are ready before the first starts - skew is one DAC frame
+	static esp_err_t analog_outputs_write(MCP4922::in_t val1, MCP4922::in_t val2)
+	{
+		spi_transaction_t &trx1 = trx_out[0];
+		spi_transaction_t &trx2 = trx_out[1];
+		dac.write_trx(trx1, val1);
+		dac.write_trx(trx2, val2);
+
+		ESP_RETURN_ON_ERROR(
+			dac.send_trx(trx1),
+			TAG, "Failed to dac.send_trx!");
+
+		ESP_RETURN_ON_ERROR(
+			dac.recv_trx(),
+			TAG, "Failed to dac.recv_trx!");
+
+		ESP_RETURN_ON_ERROR(
+			dac.send_trx(trx2),
+			TAG, "Failed to dac.send_trx!");
+
+		ESP_RETURN_ON_ERROR(
+			dac.recv_trx(),
+			TAG, "Failed to dac.recv_trx!");
+
+		return ESP_OK;
+	}
+
 	static esp_err_t analog_outputs_reset()
 	{
 		constexpr MCP4922::in_t midpoint = MCP4922::ref / 2;
@@ -307,6 +772,146 @@ namespace Board
 		dg_out_state ^= in;
 		digital_outputs_to_registers();
 	}
+	static void digital_outputs_msk(uint32_t keep, uint32_t in)
+	{
+		dg_out_state = (dg_out_state & keep) ^ in;
+		digital_outputs_to_registers();
+	}
+
+	// PIPELINE
+
+	// ConvertTask polls every tick anyway, wake it early only when a queue fills up
+	static inline void convert_kick(size_t fill, size_t len)
+	{
+		if (fill >= len / 2 && convert_idle.load(std::memory_order::relaxed) && converting.load(std::memory_order::relaxed))
+			xTaskNotifyGive(convert_task);
+	}
+
+	// Back-pressure on a full queue: wakes ConvertTask and spins until it frees a slot, it runs on the other core.
+	// Fails only as writing to the Communicator directly did, when its buffer is full. Once the stream is closed
+	// the record is dropped, the executor stops at its next check
+	template <typename Q, typename T>
+	static inline bool convert_push(Q &queue, const T &item)
+	{
+		if (convert_failed.load(std::memory_order::relaxed)) [[unlikely]] // the data would not be sent anyway
+			return false;
+		while (!queue.push(item)) [[unlikely]]
+		{
+			if (convert_failed.load(std::memory_order::relaxed))
+				return false;
+			if (Communicator::should_exit())
+				return true;
+			if (convert_idle.load(std::memory_order::relaxed))
+				xTaskNotifyGive(convert_task);
+		}
+		convert_kick(queue.size(), queue.capacity());
+		return true;
+	}
+
+	static inline bool raw_push(const RawRecord &rec)
+	{
+		return convert_push(raw_queue, rec);
+	}
+
+	static inline bool scan_push(const ScanFrame &frame)
+	{
+		return convert_push(scan_queue, frame);
+	}
+
+	// Mean of cnt readings as an ADC code
+	static uint16_t mean_code(int32_t sum, uint32_t cnt)
+	{
+		const int32_t half = cnt / 2;
+		int32_t mean = (cnt == 1) ? sum : (sum >= 0 ? sum + half : sum - half) / static_cast<int32_t>(cnt);
+		return std::clamp<int32_t>(mean + halfrangein, 0, MCP3204::max);
+	}
+
+	// DIRD states are passed through
+	static uint16_t raw_to_code(const RawRecord &rec)
+	{
+		if (rec.kind == RawKind::Value)
+			return rec.val & MCP3204::max;
+		return mean_code(rec.val, rec.cnt);
+	}
+
+	static bool raw_convert(const RawRecord &rec)
+	{
+		if (raw_codes)
+			return Communicator::write_code(rec.time, raw_to_code(rec));
+
+		switch (rec.kind)
+		{
+		case RawKind::Float:
+			return Communicator::write_data(rec.time, bin_to_phy<float>(rec.in, rec.rng, rec.val, rec.cnt));
+		case RawKind::Milli:
+			return Communicator::write_data(rec.time, bin_to_phy<int32_t, 1'000>(rec.in, rec.rng, rec.val, rec.cnt));
+		case RawKind::Micro:
+			return Communicator::write_data(rec.time, bin_to_phy<int32_t, 1'000'000>(rec.in, rec.rng, rec.val, rec.cnt));
+		default:
+			return Communicator::write_data(rec.time, rec.val);
+		}
+	}
+
+	static bool scan_convert(const ScanFrame &frame)
+	{
+		std::array<char, 4 * an_in_num> payload;
+		size_t len = 0;
+		size_t bit = 0;
+
+		auto put = [&](auto val)
+		{
+			std::memcpy(payload.data() + len, &val, 4);
+			len += 4;
+		};
+
+		if (scan_cfg.format == ScanFormat::Raw)
+			payload.fill(0);
+
+		for (size_t i = 0; i < an_in_num; ++i)
+		{
+			if (!(scan_cfg.mask & BIT(i)))
+				continue;
+
+			const Input in = static_cast<Input>(i + 1);
+			const AnIn_Range rng = scan_cfg.ranges[i];
+			const int32_t sum = frame.sums[i];
+			const int32_t cnt = scan_cfg.oversample;
+
+			switch (scan_cfg.format)
+			{
+			case ScanFormat::Float:
+				put(bin_to_phy<float>(in, rng, sum, cnt));
+				break;
+			case ScanFormat::Milli:
+				put(bin_to_phy<int32_t, 1'000>(in, rng, sum, cnt));
+				break;
+			case ScanFormat::Micro:
+				put(bin_to_phy<int32_t, 1'000'000>(in, rng, sum, cnt));
+				break;
+			case ScanFormat::Raw:
+			{
+				uint16_t code = mean_code(sum, cnt);
+				payload[bit / 8] |= code << (bit % 8);
+				payload[bit / 8 + 1] |= code >> (8 - bit % 8);
+				bit += 12;
+				len = (bit + 7) / 8;
+				break;
+			}
+			}
+		}
+
+		return Communicator::write_frame(frame.time, etl::span<const char>(payload.data(), len));
+	}
+
+	// Waits until ConvertTask has written everything queued
+	static void raw_drain()
+	{
+		while (!raw_queue.empty() || !scan_queue.empty() || !convert_idle.load())
+		{
+			xTaskNotifyGive(convert_task);
+			vTaskDelay(1);
+		}
+	}
 
 	// DIGITAL INPUT
 
@@ -327,6 +932,7 @@ namespace Board
 	{
 		for (size_t i = 0; i < an_in_num; ++i)
 			an_in_range[i] = AnIn_Range::OFF;
+		cic_states.fill(CicState());
 
 		digital_outputs_wr(0);
 
@@ -358,26 +964,65 @@ namespace Board
 		return high_task_awoken == pdTRUE;
 	}
 
+#if SYNC_COLLECT_STATS
+
+#define SYNC_STATS_WAITED(WAITED) sync_waited = (WAITED)
+#define SYNC_STATS_AFTER(INSTR)                  \
+	do                                           \
+	{                                            \
+		sync_ccount = esp_cpu_get_cycle_count(); \
+		sync_target = time_sync;                 \
+		sync_instr = (INSTR);                    \
+		sync_passed = true;                      \
+	} while (0)
+
+#else
+
+#define SYNC_STATS_WAITED(WAITED)
+#define SYNC_STATS_AFTER(INSTR)
+
+#endif
+
 #if SYNC_USE_NOTIF_NOT_SEM
 
-#define WAIT_FOR_SYNC                                                                   \
-	do                                                                                  \
-	{                                                                                   \
-		if (wait_for_sync)                                                              \
-			while (ulTaskNotifyTakeIndexed(notif_idx, pdTRUE, portMAX_DELAY) != pdTRUE) \
-				;                                                                       \
+#define WAIT_FOR_SYNC(INSTR)                                                                  \
+	do                                                                                        \
+	{                                                                                         \
+		if (wait_for_sync)                                                                    \
+		{                                                                                     \
+			if (sync_spin)                                                                    \
+				spin_to_sync();                                                               \
+			else                                                                              \
+			{                                                                                 \
+				SYNC_STATS_WAITED(ulTaskNotifyValueClearIndexed(nullptr, notif_idx, 0) == 0); \
+				while (ulTaskNotifyTakeIndexed(notif_idx, pdTRUE, portMAX_DELAY) != pdTRUE)   \
+					;                                                                         \
+			}                                                                                 \
+			SYNC_STATS_AFTER(INSTR);                                                          \
+		}                                                                                     \
+		wait_for_sync = false;                                                                \
 	} while (0)
 
 #define CLEAR_SYNC ulTaskNotifyTakeIndexed(notif_idx, pdTRUE, 0)
 
 #else
 
-#define WAIT_FOR_SYNC                                                       \
-	do                                                                      \
-	{                                                                       \
-		if (wait_for_sync)                                                  \
-			while (xSemaphoreTake(sync_semaphore, portMAX_DELAY) != pdTRUE) \
-				;                                                           \
+#define WAIT_FOR_SYNC(INSTR)                                                    \
+	do                                                                          \
+	{                                                                           \
+		if (wait_for_sync)                                                      \
+		{                                                                       \
+			if (sync_spin)                                                      \
+				spin_to_sync();                                                 \
+			else                                                                \
+			{                                                                   \
+				SYNC_STATS_WAITED(uxSemaphoreGetCount(sync_semaphore) == 0);    \
+				while (xSemaphoreTake(sync_semaphore, portMAX_DELAY) != pdTRUE) \
+					;                                                           \
+			}                                                                   \
+			SYNC_STATS_AFTER(INSTR);                                            \
+		}                                                                       \
+		wait_for_sync = false;                                                  \
 	} while (0)
 
 #define CLEAR_SYNC xSemaphoreTake(sync_semaphore, 0)
@@ -390,39 +1035,1126 @@ namespace Board
 		return time_now;
 	}
 
-	static void interpreter_task(void *arg)
+	// Busy-waits until time_sync
+	static inline void spin_to_sync()
 	{
-		__attribute__((unused)) esp_err_t ret; // used in on_false macros
+		uint64_t now = get_now();
+		SYNC_STATS_WAITED(now < time_sync);
+		if (now >= time_sync)
+			return;
+
+		uint32_t start = esp_cpu_get_cycle_count();
+		uint32_t cycles = static_cast<uint32_t>(time_sync - now) * cpu_mhz;
+		cycles -= std::min(cycles, spin_lead_cycles);
+		while (esp_cpu_get_cycle_count() - start < cycles)
+			;
+	}
+
+#if SYNC_COLLECT_STATS
+	static inline size_t stats_bucket(uint32_t us)
+	{
+		return us ? std::min<size_t>(32 - __builtin_clz(us), RunStats::hist_bins - 1) : 0;
+	}
 
-		Input in;
-		Output out;
+	// Records the last passed sync point, off the timing critical path: before the next one is armed, or at the end
+	// Its pass time is taken back from the cycle count, which wraps after 2^32 cycles (17s at 240MHz) without a sync point
+	static void stats_record()
+	{
+		sync_passed = false;
+		Interpreter::InstrPtr instr = sync_instr;
 
-		ESP_LOGI(TAG, "Starting the Board executor...");
-		while (true)
+		uint64_t since = (esp_cpu_get_cycle_count() - sync_ccount) / cpu_mhz;
+		uint64_t now = get_now();
+		uint64_t passed = now - std::min(now, since);
+		uint32_t lag = std::min<uint64_t>(passed - std::min(passed, sync_target), std::numeric_limits<uint32_t>::max());
+
+		++run_stats.syncs;
+		++run_stats.io_hist[stats_bucket(lag)];
+		if (!sync_waited)
 		{
-			ESP_LOGI(TAG, "Waiting for task...");
-			while (!Communicator::is_running())
-				vTaskDelay(1);
+			if (instr)
+				++run_stats.overruns[static_cast<size_t>(instr->opc)];
+			else
+				++run_stats.scan_overruns;
+		}
+		else if (sync_spin)
+			++run_stats.spin_hist[stats_bucket(lag)];
+		else
+			++run_stats.wake_hist[stats_bucket(lag)];
 
-			ESP_LOGI(TAG, "Dispatched...");
+		if (lag > run_stats.max_lag_us || run_stats.syncs == 1)
+		{
+			run_stats.max_lag_us = lag;
+			run_stats.worst_instr = instr ? program.index_of(instr) : size_t(-1);
+		}
+	}
+#endif
 
-			// lock access
-			std::lock_guard<std::mutex> lock(data_mutex);
+	// Prepares the wait for time_sync: close ones are spun to, the rest blocks on the alarm
+	// A sync point is also where the previous one gets recorded, and where the program is stopped on request
+	static inline esp_err_t arm_sync(uint64_t now)
+	{
+#if SYNC_COLLECT_STATS
+		if (sync_passed)
+			stats_record();
+#endif
+		if (program.poll_stop()) [[unlikely]]
+		{
+			wait_for_sync = false;
+			return ESP_OK;
+		}
 
-			// prepare hardware
-			ESP_GOTO_ON_ERROR(
-				port_cleanup(),
-				label_fail, TAG, "Failed to port_cleanup!");
+		wait_for_sync = true;
+		sync_spin = time_sync < now + spin_us;
+		if (sync_spin)
+			return ESP_OK;
 
-			// prepare software
-			ESP_GOTO_ON_FALSE(
-				program.isValid(),
-				ESP_ERR_INVALID_STATE, label_fail, TAG, "Program is invalid!");
+		CLEAR_SYNC;
+		return gptimer_set_alarm_action(sync_timer, &sync_alarm_cfg);
+	}
 
-			program.reset();
+	// INSTRUCTION HANDLERS
+	// Each handler does only the work its opcode needs (sync wait included), and reports failure via esp_err_t.
 
-			// letsgooo
-			time_now = 0;
+	using Interpreter::Instruction;
+	using exec_t = esp_err_t (*)(const Instruction &);
+
+	static esp_err_t exec_invalid(const Instruction &instr)
+	{
+		ESP_LOGE(TAG, "Invalid OPCode: %" PRIu8 "!", static_cast<uint8_t>(instr.opc));
+		return ESP_FAIL;
+	}
+
+	static inline esp_err_t delay_by(uint32_t us)
+	{
+		time_sync += us;
+		uint64_t now = get_now();
+#if SYNC_COLLECT_STATS
+		if (now >= time_sync)
+			++run_stats.armed_late;
+#endif
+		ESP_RETURN_ON_ERROR(
+			arm_sync(now),
+			TAG, "Failed to arm_sync in OPCode::DELAY*!");
+		return ESP_OK;
+	}
+
+	static esp_err_t exec_delay(const Instruction &instr)
+	{
+		return delay_by(instr.arg.u);
+	}
+
+	static esp_err_t exec_delaystep(const Instruction &instr)
+	{
+		return delay_by(Interpreter::delay_round(program.step_value(instr)));
+	}
+
+	static esp_err_t exec_gettm(const Instruction &instr)
+	{
+		uint64_t now = get_now();
+		time_sync = std::max(time_sync, now);
+		ESP_RETURN_ON_ERROR(
+			arm_sync(now),
+			TAG, "Failed to arm_sync in OPCode::GETTM!");
+		return ESP_OK;
+	}
+
+	static esp_err_t exec_rsttm(const Instruction &instr)
+	{
+		WAIT_FOR_SYNC(&instr);
+#if SYNC_COLLECT_STATS
+		if (sync_passed) // before the time base changes
+			stats_record();
+#endif
+		time_sync = -1;
+		time_now = 0;
+		CLEAR_SYNC;
+		ESP_RETURN_ON_ERROR(
+			gptimer_set_alarm_action(sync_timer, &sync_alarm_cfg),
+			TAG, "Failed to gptimer_set_alarm_action in OPCode::RSTTM!");
+		time_sync = 0;
+		ESP_RETURN_ON_ERROR(
+			gptimer_set_raw_count(sync_timer, time_now),
+			TAG, "Failed to gptimer_set_raw_count in OPCode::RSTTM!");
+		return ESP_OK;
+	}
+
+	static esp_err_t exec_dird(const Instruction &instr)
+	{
+		WAIT_FOR_SYNC(&instr);
+		uint32_t val;
+		digital_inputs_read(val);
+		ESP_RETURN_ON_FALSE(
+			raw_push({get_now(), static_cast<int32_t>(val), 1, RawKind::Value, Input::None, AnIn_Range::OFF}),
+			ESP_ERR_NO_MEM, TAG, "Communicator fail in OPCode::DIRD - no buffer space!");
+		return ESP_OK;
+	}
+
+	template <void (*func)(uint32_t)>
+	static esp_err_t exec_do(const Instruction &instr)
+	{
+		WAIT_FOR_SYNC(&instr);
+		func(instr.arg.u);
+		return ESP_OK;
+	}
+
+	static esp_err_t exec_domsk(const Instruction &instr)
+	{
+		WAIT_FOR_SYNC(&instr);
+		digital_outputs_msk(instr.port, instr.arg.u);
+		return ESP_OK;
+	}
+
+	template <RawKind kind>
+	static esp_err_t exec_aird(const Instruction &instr)
+	{
+		Input in = static_cast<Input>(instr.port);
+		WAIT_FOR_SYNC(&instr);
+		int32_t sum;
+		ESP_RETURN_ON_ERROR(
+			analog_input_read(in, instr.arg.u, sum),
+			TAG, "Failed to analog_input_read in OPCode::AIRD*!");
+		ESP_RETURN_ON_FALSE(
+			raw_push({get_now(), sum, instr.arg.u, kind, in, an_in_range[instr.port - 1]}),
+			ESP_ERR_NO_MEM, TAG, "Communicator fail in OPCode::AIRD* - no buffer space!");
+		return ESP_OK;
+	}
+
+	static esp_err_t exec_airdb(const Instruction &instr)
+	{
+		std::array<int32_t, an_in_num> sums;
+		WAIT_FOR_SYNC(&instr);
+		ESP_RETURN_ON_ERROR(
+			analog_inputs_burst(instr.port, instr.arg.u, sums),
+			TAG, "Failed to analog_inputs_burst in OPCode::AIRDB!");
+		uint64_t now = get_now();
+		for (size_t i = 0; i < an_in_num; ++i)
+			if (instr.port & BIT(i))
+				ESP_RETURN_ON_FALSE(
+					raw_push({now, sums[i], instr.arg.u, RawKind::Float, static_cast<Input>(i + 1), an_in_range[i]}),
+					ESP_ERR_NO_MEM, TAG, "Communicator fail in OPCode::AIRDB - no buffer space!");
+		return ESP_OK;
+	}
+
+	static esp_err_t exec_airdc(const Instruction &instr)
+	{
+		Input in = static_cast<Input>(instr.port);
+		WAIT_FOR_SYNC(&instr);
+		int32_t val;
+		ESP_RETURN_ON_ERROR(
+			analog_input_cic(in, instr.arg.u, val),
+			TAG, "Failed to analog_input_cic in OPCode::AIRDC!");
+		ESP_RETURN_ON_FALSE(
+			raw_push({get_now(), val, cic_frac, RawKind::Float, in, an_in_range[instr.port - 1]}),
+			ESP_ERR_NO_MEM, TAG, "Communicator fail in OPCode::AIRDC - no buffer space!");
+		return ESP_OK;
+	}
+
+	static esp_err_t exec_aoval(const Instruction &instr)
+	{
+		Output out = static_cast<Output>(instr.port);
+		MCP4922::in_t outval = phy_to_dac(out, instr.arg.f);
+		WAIT_FOR_SYNC(&instr);
+		ESP_RETURN_ON_ERROR(
+			analog_output_write(out, outval),
+			TAG, "Failed to analog_output_write in OPCode::AOVAL!");
+		return ESP_OK;
+	}
+
+	static esp_err_t exec_aogen(const Instruction &instr)
+	{
+		Output out = static_cast<Output>(instr.port);
+		MCP4922::in_t outval = generator_code(out, instr.arg.u);
+		WAIT_FOR_SYNC(&instr);
+		ESP_RETURN_ON_ERROR(
+			analog_output_write(out, outval),
+			TAG, "Failed to analog_output_write in OPCode::AOGEN!");
+		return ESP_OK;
+	}
+
+	static esp_err_t exec_aodual(const Instruction &instr)
+	{
+		MCP4922::in_t outval1 = generator_code(Output::Out1, Interpreter::dual_gen(instr.arg.u, 1));
+		MCP4922::in_t outval2 = generator_code(Output::Out2, Interpreter::dual_gen(instr.arg.u, 2));
+		WAIT_FOR_SYNC(&instr);
+		ESP_RETURN_ON_ERROR(
+			analog_outputs_write(outval1, outval2),
+			TAG, "Failed to analog_outputs_write in OPCode::AODUAL!");
+		return ESP_OK;
+	}
+
+	static esp_err_t exec_aostep(const Instruction &instr)
+	{
+		Output out = static_cast<Output>(instr.port);
+		MCP4922::in_t outval = phy_to_dac(out, program.step_value(instr));
+		WAIT_FOR_SYNC(&instr);
+		ESP_RETURN_ON_ERROR(
+			analog_output_write(out, outval),
+			TAG, "Failed to analog_output_write in OPCode::AOSTEP!");
+		return ESP_OK;
+	}
+
+	static esp_err_t exec_aien(const Instruction &instr)
+	{
+		WAIT_FOR_SYNC(&instr);
+		ESP_RETURN_ON_ERROR(
+			analog_inputs_enable(),
+			TAG, "Failed to analog_inputs_enable in OPCode::AIEN!");
+		return ESP_OK;
+	}
+
+	static esp_err_t exec_aidis(const Instruction &instr)
+	{
+		WAIT_FOR_SYNC(&instr);
+		ESP_RETURN_ON_ERROR(
+			analog_inputs_disable(),
+			TAG, "Failed to analog_inputs_disable in OPCode::AIDIS!");
+		return ESP_OK;
+	}
+
+	static esp_err_t exec_airng(const Instruction &instr)
+	{
+		WAIT_FOR_SYNC(&instr);
+		ESP_RETURN_ON_ERROR(
+			analog_input_range(static_cast<Input>(instr.port), static_cast<AnIn_Range>(instr.arg.u)),
+			TAG, "Failed to analog_input_range in OPCode::AIRNG!");
+		return ESP_OK;
+	}
+
+	// DISPATCH LUT
+	constexpr size_t exec_lut_sz = static_cast<size_t>(OPCode::END) + 1;
+	constexpr std::array<exec_t, exec_lut_sz> exec_lut = []()
+	{
+		std::array<exec_t, exec_lut_sz> ret = {};
+		ret.fill(exec_invalid); // NOP, LOOP, END never reach the executor
+
+		ret[static_cast<size_t>(OPCode::AIRDF)] = exec_aird<RawKind::Float>;
+		ret[static_cast<size_t>(OPCode::AIRDM)] = exec_aird<RawKind::Milli>;
+		ret[static_cast<size_t>(OPCode::AIRDU)] = exec_aird<RawKind::Micro>;
+		ret[static_cast<size_t>(OPCode::AIRDB)] = exec_airdb;
+		ret[static_cast<size_t>(OPCode::AIRDC)] = exec_airdc;
+
+		ret[static_cast<size_t>(OPCode::AIEN)] = exec_aien;
+		ret[static_cast<size_t>(OPCode::AIDIS)] = exec_aidis;
+		ret[static_cast<size_t>(OPCode::AIRNG)] = exec_airng;
+
+		ret[static_cast<size_t>(OPCode::AOVAL)] = exec_aoval;
+		ret[static_cast<size_t>(OPCode::AOGEN)] = exec_aogen;
+		ret[static_cast<size_t>(OPCode::AOSTEP)] = exec_aostep;
+		ret[static_cast<size_t>(OPCode::AODUAL)] = exec_aodual;
+
+		ret[static_cast<size_t>(OPCode::DIRD)] = exec_dird;
+
+		ret[static_cast<size_t>(OPCode::DOWR)] = exec_do<digital_outputs_wr>;
+		ret[static_cast<size_t>(OPCode::DOSET)] = exec_do<digital_outputs_set>;
+		ret[static_cast<size_t>(OPCode::DORST)] = exec_do<digital_outputs_rst>;
+		ret[static_cast<size_t>(OPCode::DOAND)] = exec_do<digital_outputs_and>;
+		ret[static_cast<size_t>(OPCode::DOXOR)] = exec_do<digital_outputs_xor>;
+		ret[static_cast<size_t>(OPCode::DOMSK)] = exec_domsk;
+
+		ret[static_cast<size_t>(OPCode::DELAY)] = exec_delay;
+		ret[static_cast<size_t>(OPCode::DELAYSTEP)] = exec_delaystep;
+		ret[static_cast<size_t>(OPCode::GETTM)] = exec_gettm;
+		ret[static_cast<size_t>(OPCode::RSTTM)] = exec_rsttm;
+
+		return ret;
+	}();
+
+	static inline exec_t get_exec(OPCode opc)
+	{
+		size_t idx = static_cast<size_t>(opc);
+		if (idx >= exec_lut_sz) [[unlikely]]
+			return exec_invalid;
+		return exec_lut[idx];
+	}
+
+	// The executor loop: fetch and dispatch only, failures and stop requests surface where they can happen
+	static esp_err_t program_run(Interpreter::StopCb stop)
+	{
+		program.reset(stop);
+		while (true)
+		{
+			Interpreter::InstrPtr stmt = program.getInstr();
+
+			if (stmt == Interpreter::nullinstr) [[unlikely]]
+				return ESP_OK;
+
+			// ESP_LOGD(TAG, "OPCode: %" PRId32 ", argu: %" PRIu32 ", argf: %f, port: %" PRIu8, int32_t(stmt->opc), stmt->arg.u, stmt->arg.f, stmt->port);
+			// ESP_LOGD(TAG, "Now: %" PRIu64 ", Wait: %" PRIu64, time_now, time_sync);
+
+			esp_err_t ret = get_exec(stmt->opc)(*stmt);
+
+			if (ret != ESP_OK) [[unlikely]]
+				return ret;
+		}
+	}
+
+	// Converts and serializes what the executor queues, pops only while a run is converting
+	static void converter_task(void *arg)
+	{
+		ESP_LOGI(TAG, "Starting the Board converter...");
+		while (true)
+		{
+			convert_idle.store(true);
+			if ((raw_queue.empty() && scan_queue.empty()) || !converting.load())
+				ulTaskNotifyTake(pdTRUE, converting.load() ? 1 : portMAX_DELAY); // polls each tick while running
+			convert_idle.store(false);
+
+			if (!converting.load())
+				continue;
+
+			RawRecord rec;
+			while (raw_queue.pop(rec))
+				if (!raw_convert(rec)) [[unlikely]]
+					convert_failed.store(true, std::memory_order::relaxed);
+
+			ScanFrame frame;
+			while (scan_queue.pop(frame))
+				if (!scan_convert(frame)) [[unlikely]]
+					convert_failed.store(true, std::memory_order::relaxed);
+		}
+		// never ends
+	}
+
+#if EXPANDER_ASYNC
+	// Writes what AIEN/AIDIS posted, states superseded before their turn are skipped
+	static void expander_worker(void *arg)
+	{
+		ESP_LOGI(TAG, "Starting the Board expander writer...");
+		while (true)
+		{
+			ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+			for (bool again = true; again;)
+			{
+				again = false;
+				for (size_t e = 0; e < expander_num; ++e)
+				{
+					uint32_t seq = expander_posted[e].load();
+					if (seq == expander_written[e].load())
+						continue;
+					if (expander(e).set_pins(expander_want[e].load()) != ESP_OK) [[unlikely]]
+					{
+						expander(e).invalidate(); // the next write goes out whatever the shadows say
+						expander_failed.store(true);
+					}
+					expander_written[e].store(seq);
+					again = true;
+				}
+			}
+		}
+		// never ends
+	}
+#endif
+
+	// Reads the scanned inputs at the sync point
+	static esp_err_t scan_frame(uint8_t mask, bool single, ScanFrame &frame)
+	{
+		frame.sums.fill(0);
+		WAIT_FOR_SYNC(Interpreter::nullinstr);
+
+		if (single) // polling pipeline, no per-transaction interrupt
+		{
+			const size_t i = __builtin_ctz(mask);
+			ESP_RETURN_ON_ERROR(
+				analog_input_read(static_cast<Input>(i + 1), scan_cfg.oversample, frame.sums[i]),
+				TAG, "Failed to analog_input_read in scan!");
+		}
+		else
+			ESP_RETURN_ON_ERROR(
+				analog_inputs_burst(mask, scan_cfg.oversample, frame.sums),
+				TAG, "Failed to analog_inputs_burst in scan!");
+
+		frame.time = get_now();
+		return ESP_OK;
+	}
+
+	// Between frames: checks the converter and arms the next sync point, unless the Communicator asks to exit
+	static esp_err_t scan_next(bool &exit)
+	{
+		ESP_RETURN_ON_FALSE(
+			!convert_failed.load(std::memory_order::relaxed),
+			ESP_ERR_NO_MEM, TAG, "Communicator fail - no buffer space!");
+
+		exit = Communicator::should_exit();
+		if (exit) [[unlikely]]
+		{
+			ESP_LOGW(TAG, "Communicator requests to exit!");
+			return ESP_OK;
+		}
+
+		ESP_RETURN_ON_ERROR(
+			delay_by(scan_cfg.period_us),
+			TAG, "Failed to delay_by in scan!");
+
+		return ESP_OK;
+	}
+
+	// Schmitt edge detector: analog levels as sums of codes, digital states as 0 / 1
+	struct EdgeDetector
+	{
+		int32_t rise_arm = 0;  // below it arms the rising edge...
+		int32_t rise_fire = 0; // ...which fires at or above it
+		int32_t fall_arm = 0;  // above it arms the falling edge...
+		int32_t fall_fire = 0; // ...which fires at or below it
+		bool rising = false;
+		bool falling = false;
+		bool rise_armed = false;
+		bool fall_armed = false;
+
+		bool operator()(int32_t v)
+		{
+			bool fired = false;
+			if (rising)
+			{
+				if (rise_armed && v >= rise_fire)
+					fired = true, rise_armed = false;
+				else if (v < rise_arm)
+					rise_armed = true;
+			}
+			if (falling)
+			{
+				if (fall_armed && v <= fall_fire)
+					fired = true, fall_armed = false;
+				else if (v > fall_arm)
+					fall_armed = true;
+			}
+			return fired;
+		}
+	};
+
+	static EdgeDetector trigger_detector()
+	{
+		const ScanTrigger &tr = scan_cfg.trigger;
+		EdgeDetector det;
+		det.rising = tr.edge != TriggerEdge::Falling;
+		det.falling = tr.edge != TriggerEdge::Rising;
+
+		if (tr.source == TriggerSource::Digital)
+		{
+			det.rise_arm = det.rise_fire = 1;
+			det.fall_arm = det.fall_fire = 0;
+			return det;
+		}
+
+		// inverse of bin_to_phy, calibration included
+		const size_t pos = tr.port - 1;
+		const InCoef &cf = in_coefs[pos][static_cast<size_t>(scan_cfg.ranges[pos])];
+		auto to_sum = [&](float phy)
+		{
+			double sum = std::round((phy - cf.offset) / cf.scale * scan_cfg.oversample);
+			return static_cast<int32_t>(std::clamp<double>(sum, INT32_MIN, INT32_MAX));
+		};
+
+		det.rise_fire = det.fall_fire = to_sum(tr.level);
+		det.rise_arm = to_sum(tr.level - tr.hysteresis);
+		det.fall_arm = to_sum(tr.level + tr.hysteresis);
+		return det;
+	}
+
+	// Queues a window for ConvertTask in chunks the Communicator has room for, sampling pauses meanwhile
+	static esp_err_t trigger_send(size_t oldest)
+	{
+		const size_t win = trig_ring.size();
+		const size_t room = 2 * trig_chunk * (scan_frame_bytes(scan_cfg) + sizeof(uint64_t)); // wrap of the bip buffer, max time bytes
+
+		for (size_t i = 0; i < win;)
+		{
+			while (!scan_queue.empty() || Communicator::available() < room)
+			{
+				ESP_RETURN_ON_FALSE(
+					!convert_failed.load(std::memory_order::relaxed),
+					ESP_ERR_NO_MEM, TAG, "Communicator fail - no buffer space!");
+
+				if (Communicator::should_exit()) [[unlikely]]
+					return ESP_OK;
+
+				xTaskNotifyGive(convert_task);
+				vTaskDelay(1);
+			}
+
+			for (const size_t end = std::min(win, i + trig_chunk); i < end; ++i)
+				scan_push(trig_ring[(oldest + i) % win]);
+			xTaskNotifyGive(convert_task);
+		}
+
+		return ESP_OK;
+	}
+
+	// Frames run through the ring, a trigger after at least pre of them completes the window with post ones
+	static esp_err_t scan_triggered(uint8_t mask, bool single)
+	{
+		const ScanTrigger &tr = scan_cfg.trigger;
+		const size_t win = trig_ring.size();
+		const size_t pos = tr.port - 1;
+
+		EdgeDetector det = trigger_detector();
+		size_t head = 0;   // slot of the next frame
+		size_t filled = 0; // valid frames in the ring
+		size_t left = 0;   // post frames still to take, 0 while waiting for the trigger
+
+		for (uint32_t n = 0; tr.captures == 0 || n < tr.captures;)
+		{
+			ScanFrame &frame = trig_ring[head];
+			ESP_RETURN_ON_ERROR(
+				scan_frame(mask, single, frame),
+				TAG, "Failed to scan_frame!");
+
+			head = (head + 1 == win) ? 0 : head + 1;
+			filled = std::min(filled + 1, win);
+
+			if (left == 0)
+			{
+				int32_t v = 0;
+				if (tr.source == TriggerSource::Digital)
+				{
+					uint32_t val;
+					digital_inputs_read(val);
+					v = (val >> pos) & 1;
+				}
+				else
+					v = frame.sums[pos];
+
+				if (det(v) && filled > tr.pre) // edges while the pre frames fill up are missed
+					left = tr.post;
+			}
+
+			if (left != 0 && --left == 0) // the ring is full, head is the oldest
+			{
+				ESP_RETURN_ON_ERROR(
+					trigger_send(head),
+					TAG, "Failed to trigger_send!");
+
+				++n;
+				filled = 0;
+				det = trigger_detector();
+				time_sync = std::max(time_sync, get_now()); // no catching up after the pause
+			}
+
+			bool exit = false;
+			ESP_RETURN_ON_ERROR(
+				scan_next(exit),
+				TAG, "Failed to scan_next!");
+			if (exit)
+				break;
+		}
+
+		return ESP_OK;
+	}
+
+	// One sync point per frame and no instruction fetch, runs until frames are done or the Communicator asks to exit
+	static esp_err_t scan_run()
+	{
+		const uint8_t mask = scan_cfg.mask;
+		const bool single = __builtin_popcount(mask) == 1;
+
+		for (size_t i = 0; i < an_in_num; ++i)
+			an_in_range[i] = (mask & BIT(i)) ? scan_cfg.ranges[i] : AnIn_Range::OFF;
+
+		ESP_RETURN_ON_ERROR(
+			analog_inputs_enable(),
+			TAG, "Failed to analog_inputs_enable in scan!");
+
+		if (scan_cfg.trigger.source != TriggerSource::None)
+			return scan_triggered(mask, single);
+
+		for (uint64_t n = 0; scan_cfg.frames == 0 || n < scan_cfg.frames; ++n)
+		{
+			ScanFrame frame;
+			ESP_RETURN_ON_ERROR(
+				scan_frame(mask, single, frame),
+				TAG, "Failed to scan_frame!");
+
+			ESP_RETURN_ON_FALSE(
+				scan_push(frame),
+				ESP_ERR_NO_MEM, TAG, "Communicator fail in scan - no buffer space!");
+
+			bool exit = false;
+			ESP_RETURN_ON_ERROR(
+				scan_next(exit),
+				TAG, "Failed to scan_next!");
+			if (exit)
+				break;
+		}
+
+		return ESP_OK;
+	}
+
+	// No sync points, CCOUNT is extended to 64 bits between samples. The GPIO read and the compare
+	// are all a sample costs, records are only encoded on changes
+	static esp_err_t logic_run()
+	{
+		std::array<char, logic_block> block;
+		size_t len = 0;
+		uint64_t flushed = 0;
+
+		auto put = [&](uint64_t val)
+		{
+			do
+			{
+				uint8_t b = val & 0x7F;
+				val >>= 7;
+				block[len++] = b | (val ? 0x80 : 0);
+			} while (val);
+		};
+
+		auto flush = [&]()
+		{
+			bool ok = len == 0 || Communicator::write_bytes(etl::span<const char>(block.data(), len));
+			len = 0;
+			logic_result.overflow = !ok;
+			return ok;
+		};
+
+		const uint32_t mask = logic_cfg.mask;
+		const uint32_t period = logic_cfg.period_cycles;
+		const uint64_t end = logic_cfg.duration_us ? logic_cfg.duration_us * cpu_mhz : UINT64_MAX;
+		const uint32_t limit = logic_cfg.transitions ? logic_cfg.transitions + 1 : UINT32_MAX; // + first record
+
+		uint32_t state;
+		digital_inputs_read(state);
+		state &= mask;
+
+		uint32_t last = esp_cpu_get_cycle_count();
+		uint32_t next = last + period;
+		uint64_t now = 0;
+		uint64_t prev = 0; // of the last record
+
+		put(state);
+		logic_result.records = 1;
+
+		for (uint32_t n = 1;; ++n)
+		{
+			uint32_t val;
+			digital_inputs_read(val);
+			val &= mask;
+
+			const uint32_t c = esp_cpu_get_cycle_count();
+			now += c - last;
+			last = c;
+
+			if (val != state) [[unlikely]]
+			{
+				put((now - prev) << 4 | val);
+				prev = now;
+				state = val;
+
+				if (len > logic_block - logic_varint_max) [[unlikely]] // room for the final record
+				{
+					if (!flush())
+						break;
+					flushed = now;
+				}
+				if (++logic_result.records >= limit) [[unlikely]]
+					break;
+			}
+
+			if (now >= end) [[unlikely]]
+				break;
+
+			if ((n & logic_poll_mask) == 0) [[unlikely]]
+			{
+				if (Communicator::should_exit())
+				{
+					ESP_LOGW(TAG, "Communicator requests to exit!");
+					break;
+				}
+				if (len && now - flushed > logic_flush_us * cpu_mhz)
+				{
+					if (!flush())
+						break;
+					flushed = now;
+				}
+			}
+
+			if (period)
+			{
+				while (static_cast<int32_t>(esp_cpu_get_cycle_count() - next) < 0)
+					;
+				next += period;
+			}
+		}
+
+		logic_result.cycles = now;
+		ESP_RETURN_ON_FALSE(
+			!logic_result.overflow,
+			ESP_ERR_NO_MEM, TAG, "Communicator fail - no buffer space!");
+
+		// final state, the length of the capture
+		put((now - prev) << 4 | state);
+		++logic_result.records;
+
+		ESP_RETURN_ON_FALSE(
+			flush(),
+			ESP_ERR_NO_MEM, TAG, "Communicator fail - no buffer space!");
+
+		return ESP_OK;
+	}
+
+	// Stop requests are polled as in a run, and never granted
+	static bool bench_no_stop()
+	{
+		return false;
+	}
+
+	// Runs on the executor with data_mutex held, so that alarm waits are woken like in a run
+	static esp_err_t benchmark_run(std::vector<std::pair<OPCode, uint32_t>> &res, std::vector<std::pair<const char *, uint32_t>> &forms, size_t reps)
+	{
+		static constexpr OPCode opcodes[] = {
+			OPCode::AIRDF, OPCode::AIRDM, OPCode::AIRDU, OPCode::AIRDB, OPCode::AIRDC,
+			OPCode::AIEN, OPCode::AIDIS, OPCode::AIRNG,
+			OPCode::AOVAL, OPCode::AOGEN, OPCode::AODUAL,
+			OPCode::DIRD,
+			OPCode::DOWR, OPCode::DOSET, OPCode::DORST, OPCode::DOAND, OPCode::DOXOR, OPCode::DOMSK,
+			OPCode::DELAY, OPCode::GETTM, OPCode::RSTTM, //
+		};
+
+		esp_err_t ret = ESP_OK;
+		Communicator::time_settings(0);
+		res.clear();
+		forms.clear();
+		program.reset(bench_no_stop); // the measured sync points poll as in a run
+#if SYNC_COLLECT_STATS
+		RunStats kept = run_stats; // of the last real run
+#endif
+
+		// cold: expander shadows are dropped first, AIEN/AIDIS do write; posted writes are waited for in any case
+		// at: time_sync seen by the handler, AOGEN/AODUAL look their sample up by it
+		auto measure = [reps](const Instruction &instr, uint32_t &cycles, bool cold = true, uint64_t at = -1) -> esp_err_t
+		{
+			exec_t exec = get_exec(instr.opc);
+			uint32_t total = 0;
+
+			for (size_t r = 0; r < reps; ++r)
+			{
+				time_sync = at;
+				wait_for_sync = false;
+				if (cold)
+					for (size_t e = 0; e < expander_num; ++e)
+						expander(e).invalidate();
+
+				uint32_t start = esp_cpu_get_cycle_count();
+				esp_err_t ret = exec(instr);
+				if (ret == ESP_OK)
+					ret = expanders_wait(0b1111);
+				total += esp_cpu_get_cycle_count() - start;
+
+				if (ret != ESP_OK)
+					return ret;
+
+				raw_queue.clear(); // drop any produced data, ConvertTask is parked
+			}
+
+			cycles = total / reps;
+			return ESP_OK;
+		};
+
+		// AOGEN/AODUAL would take the missing-generator fallback with the uploaded config,
+		// a tabled sine per output stands in for it meanwhile
+		std::vector<Generator> kept_generators = std::move(generators);
+		std::vector<std::array<GenTable, an_out_num>> kept_tables = std::move(gen_tables);
+		generators.clear();
+		gen_tables.clear();
+		gen_tables.resize(an_out_num);
+		for (size_t g = 0; g < an_out_num; ++g)
+		{
+			Generator &gen = generators.emplace_back();
+			gen.add(1.0f, make_signal<SignalSine>(bench_gen_period));
+
+			for (uint8_t port = 1; port <= an_out_num; ++port)
+			{
+				GenTable &tab = gen_tables[g][port - 1];
+				tab.period = gen.period();
+				tab.lead = gen.lead();
+				generator_table_fill(tab, gen, static_cast<Output>(port));
+			}
+		}
+
+		Interpreter::CostModel measured = cost_nominal;
+
+		for (OPCode opc : opcodes)
+		{
+			Instruction instr;
+			instr.opc = opc;
+			instr.port = 1;
+			switch (opc)
+			{
+			case OPCode::AOVAL:
+			case OPCode::AOGEN:
+				instr.arg.u = 0;
+				break;
+			case OPCode::AODUAL:
+				instr.arg.u = Interpreter::dual_arg(0, 1);
+				break;
+			case OPCode::AIRDC:
+				instr.arg.u = Interpreter::cic_arg(1, 1);
+				break;
+			default:
+				instr.arg.u = 1;
+				break;
+			}
+
+			// mid-table, past the lead, like in a running program
+			bool gen = (opc == OPCode::AOGEN || opc == OPCode::AODUAL);
+
+			uint32_t cycles = 0;
+			ret = measure(instr, cycles, true, gen ? bench_gen_period / 2 : -1);
+
+			if (ret != ESP_OK)
+			{
+				ESP_LOGE(TAG, "Benchmark of OPCode %" PRIu8 " failed!", static_cast<uint8_t>(opc));
+				break;
+			}
+
+			res.emplace_back(opc, cycles);
+			measured.base_us[static_cast<size_t>(opc)] = static_cast<float>(cycles) / cpu_mhz;
+		}
+
+		if (ret == ESP_OK) // range switch latency, from AIRNG to the data of the read on the new range
+		{
+			// write-through: both expanders written and waited for at AIEN, as before the register cache and ExpanderTask;
+			// posted: as programs run now; unchanged: the same range again, the write is suppressed
+			static constexpr std::pair<const char *, uint8_t> switches[] = {
+				{"AIRNG AIEN AIRDF 1 1, write-through", 0},
+				{"AIRNG AIEN AIRDF 1 1, posted", 1},
+				{"AIRNG AIEN AIRDF 1 1, unchanged", 2},
+			};
+
+			exec_t exec_rng = get_exec(OPCode::AIRNG);
+			exec_t exec_en = get_exec(OPCode::AIEN);
+			exec_t exec_rd = get_exec(OPCode::AIRDF);
+
+			Instruction rng;
+			rng.opc = OPCode::AIRNG;
+			rng.port = 1;
+			Instruction en;
+			en.opc = OPCode::AIEN;
+			Instruction rd;
+			rd.opc = OPCode::AIRDF;
+			rd.port = 1;
+			rd.arg.u = 1;
+
+			for (const auto &[name, mode] : switches)
+			{
+				uint32_t total = 0;
+
+				for (size_t r = 0; r < reps && ret == ESP_OK; ++r)
+				{
+					time_sync = -1;
+					wait_for_sync = false;
+					rng.arg.u = static_cast<uint32_t>((mode == 2 || r % 2) ? AnIn_Range::Max : AnIn_Range::Min);
+					if (mode == 0)
+						for (size_t e = 0; e < expander_num; ++e)
+							expander(e).invalidate();
+
+					uint32_t start = esp_cpu_get_cycle_count();
+					ret = exec_rng(rng);
+					if (ret == ESP_OK)
+						ret = exec_en(en);
+					if (ret == ESP_OK && mode == 0)
+						ret = expanders_wait(0b1111);
+					if (ret == ESP_OK)
+						ret = exec_rd(rd);
+					total += esp_cpu_get_cycle_count() - start;
+
+					if (ret == ESP_OK)
+						ret = expanders_wait(0b1111); // nothing in flight into the next rep
+					raw_queue.clear();
+				}
+
+				if (ret != ESP_OK)
+				{
+					ESP_LOGE(TAG, "Benchmark of %s failed!", name);
+					break;
+				}
+
+				forms.emplace_back(name, total / reps);
+				ESP_LOGI(TAG, "%s: %.1fus", name, static_cast<float>(total) / reps / cpu_mhz);
+			}
+		}
+
+		if (ret == ESP_OK) // AIRD* costs base + per_rep * reps, split them with a 2nd read
+		{
+			Instruction instr;
+			instr.opc = OPCode::AIRDF;
+			instr.port = 1;
+			instr.arg.u = 2;
+
+			uint32_t cycles = 0;
+			ret = measure(instr, cycles);
+
+			if (ret == ESP_OK)
+			{
+				float two = static_cast<float>(cycles) / cpu_mhz;
+				measured.per_rep_us = std::max(0.0f, two - measured.base_us[static_cast<size_t>(OPCode::AIRDF)]);
+				for (OPCode opc : {OPCode::AIRDF, OPCode::AIRDM, OPCode::AIRDU, OPCode::AIRDB, OPCode::AIRDC})
+					measured.base_us[static_cast<size_t>(opc)] = std::max(0.0f, measured.base_us[static_cast<size_t>(opc)] - measured.per_rep_us);
+				cost_model = measured;
+			}
+			else
+				ESP_LOGE(TAG, "Benchmark of AIRDF repetitions failed!");
+		}
+
+		if (ret == ESP_OK) // burst throughput, of one port and of all four interleaved
+		{
+			static constexpr std::pair<const char *, uint8_t> bursts[] = {{"AIRDB 1 64", 0b0001}, {"AIRDB 0xF 64", 0b1111}};
+
+			for (const auto &[name, mask] : bursts)
+			{
+				Instruction instr;
+				instr.opc = OPCode::AIRDB;
+				instr.port = mask;
+				instr.arg.u = 64;
+
+				uint32_t cycles = 0;
+				ret = measure(instr, cycles);
+
+				if (ret != ESP_OK)
+				{
+					ESP_LOGE(TAG, "Benchmark of %s failed!", name);
+					break;
+				}
+
+				forms.emplace_back(name, cycles);
+				ESP_LOGI(TAG, "%s: %" PRIu32 " cycles, %.1f ksps", name, cycles, 1000.0f * cpu_mhz * __builtin_popcount(mask) * instr.arg.u / cycles);
+			}
+		}
+
+		if (ret == ESP_OK) // the executor loop around the handlers: fetch, dispatch and stop polling, with a sync point already passed
+		{
+			static constexpr const char *name = "LOOP DOSET 1 DELAY 0 END, per instruction";
+
+			Interpreter::Program kept_program = std::move(program);
+			std::vector<std::string> err;
+			if (program.parse("LOOP " + std::to_string(reps) + "; DOSET 1; DELAY 0; END;", err))
+			{
+				time_sync = 0;
+				wait_for_sync = false;
+
+				uint32_t start = esp_cpu_get_cycle_count();
+				ret = program_run(bench_no_stop);
+				uint32_t cycles = (esp_cpu_get_cycle_count() - start) / (2 * reps);
+
+				if (ret == ESP_OK)
+				{
+					forms.emplace_back(name, cycles);
+					ESP_LOGI(TAG, "%s: %" PRIu32 " cycles", name, cycles);
+				}
+			}
+			else
+				ret = ESP_FAIL;
+			program = std::move(kept_program);
+
+			if (ret != ESP_OK)
+				ESP_LOGE(TAG, "Benchmark of %s failed!", name);
+		}
+
+		if (ret == ESP_OK) // alarm wakeup latency, sync points closer than a few of it get spun to
+		{
+			uint32_t start = esp_cpu_get_cycle_count();
+			get_now();
+			uint32_t read_cycles = esp_cpu_get_cycle_count() - start;
+
+			uint64_t lag = 0;
+			gptimer_set_raw_count(sync_timer, 0);
+			gptimer_start(sync_timer);
+			for (size_t r = 0; r < reps && ret == ESP_OK; ++r)
+			{
+				time_sync = get_now() + 100;
+				wait_for_sync = true;
+				sync_spin = false;
+				CLEAR_SYNC;
+				ret = gptimer_set_alarm_action(sync_timer, &sync_alarm_cfg);
+				if (ret != ESP_OK)
+					break;
+				WAIT_FOR_SYNC(Interpreter::nullinstr);
+				lag += get_now() - time_sync;
+			}
+			gptimer_stop(sync_timer);
+
+			if (ret == ESP_OK)
+			{
+				cost_model.sync_us = static_cast<float>(lag) / reps;
+				cost_model.spin_us = std::clamp(3 * cost_model.sync_us, 10.0f, 200.0f);
+				spin_us = cost_model.spin_us;
+				spin_lead_cycles = cpu_mhz / 2 + read_cycles / 2;
+				ESP_LOGI(TAG, "Wakeup latency: %.1fus, spinning below %" PRIu32 "us", cost_model.sync_us, spin_us);
+			}
+			else
+				ESP_LOGE(TAG, "Benchmark of alarm wakeups failed!");
+		}
+
+		time_sync = -1; // disarm, and leave no notification behind for the next run
+		wait_for_sync = false;
+		gptimer_set_alarm_action(sync_timer, &sync_alarm_cfg);
+		CLEAR_SYNC;
+
+		port_cleanup();
+
+		generators = std::move(kept_generators);
+		gen_tables = std::move(kept_tables);
+
+#if SYNC_COLLECT_STATS
+		run_stats = kept;
+		sync_passed = false;
+#endif
+
+		return ret;
+	}
+
+	static void interpreter_task(void *arg)
+	{
+		__attribute__((unused)) esp_err_t ret; // used in on_false macros
+
+		ESP_LOGI(TAG, "Starting the Board executor...");
+		while (true)
+		{
+			ESP_LOGI(TAG, "Waiting for task...");
+			while (!Communicator::is_running())
+			{
+				if (bench_pending.load()) [[unlikely]]
+				{
+					std::lock_guard<std::mutex> lock(data_mutex);
+					bench_ret = benchmark_run(*bench_res, *bench_forms, bench_reps);
+					bench_pending.store(false);
+				}
+				vTaskDelay(1);
+			}
+
+			ESP_LOGI(TAG, "Dispatched...");
+
+			// lock access
+			std::lock_guard<std::mutex> lock(data_mutex);
+
+			// prepare hardware
+			ESP_GOTO_ON_ERROR(
+				port_cleanup(),
+				label_fail, TAG, "Failed to port_cleanup!");
+
+			// prepare software
+			scanning = scan_armed;
+			scan_armed = false;
+			logging = logic_armed;
+			logic_armed = false;
+
+			ESP_GOTO_ON_FALSE(
+				scanning || logging || program.isValid(),
+				ESP_ERR_INVALID_STATE, label_fail, TAG, "Program is invalid!");
+
+#if SYNC_COLLECT_STATS
+			run_stats = RunStats();
+			sync_passed = false;
+#endif
+
+			raw_queue.clear();
+			scan_queue.clear();
+			convert_failed.store(false);
+			expander_failed.store(false);
+			raw_codes = Communicator::is_raw();
+			converting.store(true);
+			xTaskNotifyGive(convert_task);
+
+			// letsgooo
+			time_now = 0;
 			time_sync = -1;
 			wait_for_sync = false;
 
@@ -440,206 +2172,54 @@ namespace Board
 
 			time_sync = 0;
 
-			while (true)
+			if (logging) [[unlikely]]
 			{
-				bool comm_ok = true;
-
-				Interpreter::InstrPtr stmt = program.getInstr();
-
-				if (stmt == Interpreter::nullinstr) [[unlikely]]
-					break;
-
-				in = static_cast<Input>(stmt->port);
-				out = static_cast<Output>(stmt->port);
-
-				// ESP_LOGD(TAG, "OPCode: %" PRId32 ", argu: %" PRIu32 ", argf: %f, port: %" PRIu8, int32_t(stmt->opc), stmt->arg.u, stmt->arg.f, stmt->port);
-				// ESP_LOGD(TAG, "Now: %" PRIu64 ", Wait: %" PRIu64, time_now, time_sync);
-
-				switch (stmt->opc)
-				{
-				case OPCode::DELAY:
-					time_sync += stmt->arg.u;
-					wait_for_sync = true;
-					CLEAR_SYNC;
-					ESP_GOTO_ON_ERROR(
-						gptimer_set_alarm_action(sync_timer, &sync_alarm_cfg),
-						label_fail, TAG, "Failed to gptimer_set_alarm_action in OPCode::DELAY!");
-					continue;
-
-				case OPCode::GETTM:
-					time_sync = std::max(time_sync, get_now());
-					wait_for_sync = true;
-					CLEAR_SYNC;
-					ESP_GOTO_ON_ERROR(
-						gptimer_set_alarm_action(sync_timer, &sync_alarm_cfg),
-						label_fail, TAG, "Failed to gptimer_set_alarm_action in OPCode::GETTM!");
-					continue;
-
-				case OPCode::RSTTM:
-					WAIT_FOR_SYNC;
-					time_sync = -1;
-					wait_for_sync = false;
-					time_now = 0;
-					CLEAR_SYNC;
-					ESP_GOTO_ON_ERROR(
-						gptimer_set_alarm_action(sync_timer, &sync_alarm_cfg),
-						label_fail, TAG, "Failed to gptimer_set_alarm_action in OPCode::RSTTM!");
-					time_sync = 0;
-					ESP_GOTO_ON_ERROR(
-						gptimer_set_raw_count(sync_timer, time_now),
-						label_fail, TAG, "Failed to gptimer_set_raw_count in OPCode::RSTTM!");
-					continue;
-
-				case OPCode::DIRD:
-				{
-					WAIT_FOR_SYNC;
-					uint32_t val;
-					digital_inputs_read(val);
-					comm_ok = Communicator::write_data(get_now(), val);
-					break;
-				}
-
-				case OPCode::DOWR:
-					WAIT_FOR_SYNC;
-					digital_outputs_wr(stmt->arg.u);
-					break;
-				case OPCode::DOSET:
-					WAIT_FOR_SYNC;
-					digital_outputs_set(stmt->arg.u);
-					break;
-				case OPCode::DORST:
-					WAIT_FOR_SYNC;
-					digital_outputs_rst(stmt->arg.u);
-					break;
-				case OPCode::DOAND:
-					WAIT_FOR_SYNC;
-					digital_outputs_and(stmt->arg.u);
-					break;
-				case OPCode::DOXOR:
-					WAIT_FOR_SYNC;
-					digital_outputs_xor(stmt->arg.u);
-					break;
-
-				case OPCode::AIRDF:
-				{
-					WAIT_FOR_SYNC;
-					int32_t sum = 0;
-					MCP3204::out_t rd;
-					for (size_t r = stmt->arg.u; r; --r)
-					{
-						ESP_GOTO_ON_ERROR(
-							analog_input_read(in, rd),
-							label_fail, TAG, "Failed to analog_input_read in OPCode::AIRDF!");
-						sum += adc_offset(rd);
-					}
-					float val = bin_to_phy<float>(in, sum, stmt->arg.u);
-					comm_ok = Communicator::write_data(get_now(), val);
-					break;
-				}
-				case OPCode::AIRDM:
-				{
-					WAIT_FOR_SYNC;
-					int32_t sum = 0;
-					MCP3204::out_t rd;
-					for (size_t r = stmt->arg.u; r; --r)
-					{
-						ESP_GOTO_ON_ERROR(
-							analog_input_read(in, rd),
-							label_fail, TAG, "Failed to analog_input_read in OPCode::AIRDF!");
-						sum += adc_offset(rd);
-					}
-					int32_t val = bin_to_phy<int32_t, 1'000>(in, sum, stmt->arg.u);
-					comm_ok = Communicator::write_data(get_now(), val);
-					break;
-				}
-				case OPCode::AIRDU:
-				{
-					WAIT_FOR_SYNC;
-					int32_t sum = 0;
-					MCP3204::out_t rd;
-					for (size_t r = stmt->arg.u; r; --r)
-					{
-						ESP_GOTO_ON_ERROR(
-							analog_input_read(in, rd),
-							label_fail, TAG, "Failed to analog_input_read in OPCode::AIRDF!");
-						sum += adc_offset(rd);
-					}
-					int32_t val = bin_to_phy<int32_t, 1'000'000>(in, sum, stmt->arg.u);
-					comm_ok = Communicator::write_data(get_now(), val);
-					break;
-				}
-
-				case OPCode::AOVAL:
-				{
-					MCP4922::in_t outval = phy_to_dac(out, stmt->arg.f);
-					WAIT_FOR_SYNC;
-					ESP_GOTO_ON_ERROR(
-						analog_output_write(out, outval),
-						label_fail, TAG, "Failed to analog_output_write in OPCode::AOVAL!");
-					break;
-				}
-				case OPCode::AOGEN:
-				{
-					MCP4922::in_t outval = phy_to_dac(out, (stmt->arg.u < generators.size()) ? generators[stmt->arg.u].get(time_sync) : 0);
-					WAIT_FOR_SYNC;
-					ESP_GOTO_ON_ERROR(
-						analog_output_write(out, outval),
-						label_fail, TAG, "Failed to analog_output_write in OPCode::AOGEN!");
-					break;
-				}
-
-				case OPCode::AIEN:
-					WAIT_FOR_SYNC;
-					ESP_GOTO_ON_ERROR(
-						analog_inputs_enable(),
-						label_fail, TAG, "Failed to analog_inputs_enable in OPCode::AOVAL!");
-					break;
-				case OPCode::AIDIS:
-					WAIT_FOR_SYNC;
-					ESP_GOTO_ON_ERROR(
-						analog_inputs_disable(),
-						label_fail, TAG, "Failed to analog_inputs_disable in OPCode::AIDIS!");
-					break;
-				case OPCode::AIRNG:
-					WAIT_FOR_SYNC;
-					ESP_GOTO_ON_ERROR(
-						analog_input_range(in, static_cast<AnIn_Range>(stmt->arg.u)),
-						label_fail, TAG, "Failed to analog_input_range in OPCode::AIRNG!");
-					break;
-
-				case OPCode::NOP:
-					ESP_GOTO_ON_FALSE(
-						false, ESP_FAIL,
-						label_fail, TAG, "Failed in OPCode::NOP!");
-					break;
-				case OPCode::INV:
-					ESP_GOTO_ON_FALSE(
-						false, ESP_FAIL,
-						label_fail, TAG, "Failed in OPCode::INV!");
-					break;
-				}
+				logic_result = LogicResult();
+				logic_run(); // logs its own failure
+				goto label_fail;
+			}
 
-				wait_for_sync = false;
+			if (scanning) [[unlikely]]
+			{
+				scan_run(); // logs its own failure
+				std::vector<ScanFrame>().swap(trig_ring);
+				goto label_fail;
+			}
 
-				ESP_GOTO_ON_FALSE(
-					comm_ok,
-					ESP_ERR_NO_MEM, label_fail, TAG, "Communicator fail - no buffer space!");
+			if (program_run(Communicator::should_exit) != ESP_OK) [[unlikely]]
+				goto label_fail;
 
-				if (Communicator::should_exit()) [[unlikely]]
-				{
-					ESP_LOGW(TAG, "Communicator requests to exit!");
-					goto label_fail;
-				}
+			if (Communicator::should_exit()) [[unlikely]]
+			{
+				ESP_LOGW(TAG, "Communicator requests to exit!");
+				goto label_fail;
 			}
 
-			WAIT_FOR_SYNC;
+			WAIT_FOR_SYNC(Interpreter::nullinstr);
+#if SYNC_COLLECT_STATS
+			sync_passed = false; // the final wait has no instruction to blame
+#endif
 
 		label_fail:
+#if SYNC_COLLECT_STATS
+			if (sync_passed) // with no sync point armed after it, while the timer still runs
+				stats_record();
+#endif
 			gptimer_stop(sync_timer);
 
 			port_cleanup();
+			expanders_wait(0b1111);
+
+			raw_drain();
+			converting.store(false);
+			if (raw_codes && !Communicator::flush_codes()) [[unlikely]]
+				ESP_LOGE(TAG, "Failed to flush_codes!");
 
 			ESP_LOGI(TAG, "Execution took %" PRIu64 "us", get_now());
+#if SYNC_COLLECT_STATS
+			run_stats.run_time_us = time_now;
+			ESP_LOGI(TAG, "Syncs: %" PRIu32 ", late: %" PRIu32 ", max lag: %" PRIu32 "us", run_stats.syncs, std::accumulate(run_stats.overruns.begin(), run_stats.overruns.end(), run_stats.scan_overruns), run_stats.max_lag_us);
+#endif
 			ESP_LOGI(TAG, "Exiting...");
 			Communicator::confirm_exit();
 		}
@@ -668,7 +2248,7 @@ namespace Board
 
 		// ADC/DAC
 		for (size_t i = 0; i < an_in_num; ++i)
-			trx_in[i] = MCP3204::make_trx(i);
+			trx_in[i].fill(MCP3204::make_trx(i));
 
 		for (size_t i = 0; i < an_out_num; ++i)
 			trx_out[i] = MCP4922::make_trx(an_out_num - i - 1); // reversed, because rotated chip
@@ -698,6 +2278,18 @@ namespace Board
 			expander_b.init(true),
 			TAG, "Error in expander_b.init!");
 
+#if EXPANDER_ASYNC
+		// SPAWN EXPANDER TASK, posted writes need it from here on
+		ESP_RETURN_ON_FALSE(
+			xTaskCreatePinnedToCore(expander_worker, "ExpanderTask", EXPD_MEM, nullptr, EXPD_PRT, &expander_task, CPU0),
+			ESP_ERR_NO_MEM, TAG, "Error in xTaskCreatePinnedToCore!");
+#endif
+
+		// CALIBRATION, nominal when none is stored
+		if (calibration_load() != ESP_OK)
+			ESP_LOGW(TAG, "Using nominal calibration.");
+		calibration_fold();
+
 		// CLEANUP BOARD
 		ESP_RETURN_ON_ERROR(
 			port_cleanup(),
@@ -749,6 +2341,11 @@ namespace Board
 			xTaskCreatePinnedToCore(interpreter_task, "BoardTask", BOARD_MEM, nullptr, BOARD_PRT, &execute_task, CPU1),
 			ESP_ERR_NO_MEM, TAG, "Error in xTaskCreatePinnedToCore!");
 
+		// SPAWN CONVERT TASK
+		ESP_RETURN_ON_FALSE(
+			xTaskCreatePinnedToCore(converter_task, "ConvertTask", CONV_MEM, nullptr, CONV_PRT, &convert_task, CPU0),
+			ESP_ERR_NO_MEM, TAG, "Error in xTaskCreatePinnedToCore!");
+
 		ESP_LOGI(TAG, "Done!");
 		return ESP_OK;
 	}
@@ -761,6 +2358,10 @@ namespace Board
 		vTaskDelete(execute_task); // void
 		execute_task = nullptr;
 
+		// KILL CONVERT TASK
+		vTaskDelete(convert_task); // void
+		convert_task = nullptr;
+
 		// KILL TIMER
 		ESP_RETURN_ON_ERROR(
 			gptimer_disable(sync_timer),
@@ -781,6 +2382,15 @@ namespace Board
 			port_cleanup(),
 			TAG, "Error in port_cleanup!");
 
+#if EXPANDER_ASYNC
+		// KILL EXPANDER TASK, once the cleanup is written
+		ESP_RETURN_ON_ERROR(
+			expanders_wait(0b1111),
+			TAG, "Error in expanders_wait!");
+		vTaskDelete(expander_task); // void
+		expander_task = nullptr;
+#endif
+
 		// EXPANDER
 		ESP_RETURN_ON_ERROR(
 			expander_a.deinit(),
@@ -820,11 +2430,30 @@ namespace Board
 
 		program = std::move(p);
 		generators = std::move(g);
+		generator_tables_render();
+
+		data_mutex.unlock();
+		return ESP_OK;
+	}
+
+	esp_err_t move_program(Interpreter::Program &p)
+	{
+		if (!data_mutex.try_lock())
+			return ESP_ERR_INVALID_STATE;
+
+		program = std::move(p);
+		generator_tables_render();
 
 		data_mutex.unlock();
 		return ESP_OK;
 	}
 
+	size_t generator_count()
+	{
+		std::lock_guard lock(data_mutex);
+		return generators.size();
+	}
+
 	esp_err_t give_sem_emergency()
 	{
 #if SYNC_USE_NOTIF_NOT_SEM
@@ -836,6 +2465,273 @@ namespace Board
 		return ESP_OK;
 	}
 
+	esp_err_t arm_scan(const ScanConfig &cfg)
+	{
+		if (cfg.mask == 0 || cfg.mask > 0b1111 || cfg.oversample == 0 || cfg.period_us == 0)
+			return ESP_ERR_INVALID_ARG;
+
+		const ScanTrigger &tr = cfg.trigger;
+		const size_t win = tr.pre + tr.post;
+		if (tr.source != TriggerSource::None)
+		{
+			const bool port_ok = (tr.source == TriggerSource::Analog)
+									 ? tr.port >= 1 && tr.port <= an_in_num && (cfg.mask & BIT(tr.port - 1)) && cfg.ranges[tr.port - 1] != AnIn_Range::OFF
+									 : tr.port >= 1 && tr.port <= dg_in_num;
+
+			if (!port_ok || tr.post == 0 || tr.pre > trigger_max_frames || win > trigger_max_frames || !std::isfinite(tr.level) || !std::isfinite(tr.hysteresis) || tr.hysteresis < 0)
+				return ESP_ERR_INVALID_ARG;
+		}
+
+		if (Communicator::is_running() || !data_mutex.try_lock())
+			return ESP_ERR_INVALID_STATE;
+
+		const size_t nch = __builtin_popcount(cfg.mask);
+		const float frame_us = cost_model.base_us[static_cast<size_t>(OPCode::AIRDB)] + cost_model.per_rep_us * cfg.oversample * nch;
+		if (frame_us > cfg.period_us)
+			ESP_LOGW(TAG, "Scan frame takes ~%.0fus, longer than the period of %" PRIu32 "us!", frame_us, cfg.period_us);
+
+		std::vector<ScanFrame>().swap(trig_ring);
+		if (tr.source != TriggerSource::None)
+		{
+			if (heap_caps_get_largest_free_block(MALLOC_CAP_8BIT) < 2 * win * sizeof(ScanFrame)) // keep some for the rest
+			{
+				data_mutex.unlock();
+				return ESP_ERR_NO_MEM;
+			}
+			trig_ring.resize(win);
+		}
+
+		scan_cfg = cfg;
+		scan_armed = true;
+		logic_armed = false;
+
+		data_mutex.unlock();
+		return ESP_OK;
+	}
+
+	esp_err_t arm_logic(const LogicConfig &cfg)
+	{
+		if (cfg.mask == 0 || cfg.mask > 0b1111)
+			return ESP_ERR_INVALID_ARG;
+
+		if (Communicator::is_running() || !data_mutex.try_lock())
+			return ESP_ERR_INVALID_STATE;
+
+		logic_cfg = cfg;
+		logic_armed = true;
+		scan_armed = false;
+
+		data_mutex.unlock();
+		return ESP_OK;
+	}
+
+	esp_err_t get_logic_result(LogicResult &res)
+	{
+		if (Communicator::is_running() || !data_mutex.try_lock())
+			return ESP_ERR_INVALID_STATE;
+
+		res = logic_result;
+
+		data_mutex.unlock();
+		return ESP_OK;
+	}
+
+	uint32_t cycles_per_us()
+	{
+		return cpu_mhz;
+	}
+
+	esp_err_t disarm_scan()
+	{
+		if (Communicator::is_running() || !data_mutex.try_lock())
+			return ESP_ERR_INVALID_STATE;
+
+		scan_armed = false;
+		logic_armed = false;
+		std::vector<ScanFrame>().swap(trig_ring);
+
+		data_mutex.unlock();
+		return ESP_OK;
+	}
+
+	size_t scan_frame_bytes(const ScanConfig &cfg)
+	{
+		const size_t nch = __builtin_popcount(cfg.mask);
+		return (cfg.format == ScanFormat::Raw) ? (nch * 12 + 7) / 8 : nch * 4;
+	}
+
+	esp_err_t benchmark(std::vector<std::pair<OPCode, uint32_t>> &res, std::vector<std::pair<const char *, uint32_t>> &forms, size_t reps)
+	{
+		if (reps == 0)
+			return ESP_ERR_INVALID_ARG;
+
+		if (Communicator::is_running() || bench_pending.load())
+			return ESP_ERR_INVALID_STATE;
+
+		bench_res = &res;
+		bench_forms = &forms;
+		bench_reps = reps;
+		bench_pending.store(true);
+
+		while (bench_pending.load())
+			vTaskDelay(1);
+
+		return bench_ret;
+	}
+
+	const Interpreter::CostModel &get_cost_model()
+	{
+		return cost_model;
+	}
+
+	float raw_scale(Input in, AnIn_Range rng)
+	{
+		if (in == Input::None || in == Input::Inv)
+			return 0;
+		return in_coefs[static_cast<size_t>(in) - 1][static_cast<size_t>(rng)].scale;
+	}
+
+	float raw_offset(Input in, AnIn_Range rng)
+	{
+		if (in == Input::None || in == Input::Inv)
+			return 0;
+		return in_coefs[static_cast<size_t>(in) - 1][static_cast<size_t>(rng)].offset;
+	}
+
+	int32_t raw_code_offset()
+	{
+		return halfrangein;
+	}
+
+	esp_err_t get_calibration(Calibration &cal)
+	{
+		if (Communicator::is_running() || !data_mutex.try_lock())
+			return ESP_ERR_INVALID_STATE;
+
+		cal = calibration;
+
+		data_mutex.unlock();
+		return ESP_OK;
+	}
+
+	esp_err_t set_calibration(const Calibration &cal)
+	{
+		if (!calibration_valid(cal))
+			return ESP_ERR_INVALID_ARG;
+
+		if (Communicator::is_running() || !data_mutex.try_lock())
+			return ESP_ERR_INVALID_STATE;
+
+		calibration = cal;
+		calibration_fold();
+		generator_tables_render(); // DAC codes include the output calibration
+
+		data_mutex.unlock();
+		return ESP_OK;
+	}
+
+	esp_err_t save_calibration()
+	{
+		if (Communicator::is_running() || !data_mutex.try_lock())
+			return ESP_ERR_INVALID_STATE;
+
+		const std::pair<uint32_t, Calibration> blob = {nvs_cal_version, calibration};
+		data_mutex.unlock();
+
+		nvs_handle_t nvs;
+		ESP_RETURN_ON_ERROR(
+			nvs_open(nvs_namespace, NVS_READWRITE, &nvs),
+			TAG, "Failed to nvs_open!");
+
+		esp_err_t ret = nvs_set_blob(nvs, nvs_cal_key, &blob, sizeof(blob));
+		if (ret == ESP_OK)
+			ret = nvs_commit(nvs);
+		nvs_close(nvs);
+
+		ESP_RETURN_ON_ERROR(
+			ret,
+			TAG, "Failed to nvs_set_blob!");
+
+		return ESP_OK;
+	}
+
+	esp_err_t calibrate_capture(Input in, AnIn_Range rng, float ref, float &nominal, bool &done)
+	{
+		if (in == Input::None || in >= Input::Inv || rng == AnIn_Range::OFF || !std::isfinite(ref))
+			return ESP_ERR_INVALID_ARG;
+
+		if (Communicator::is_running() || !data_mutex.try_lock())
+			return ESP_ERR_INVALID_STATE;
+
+		esp_err_t ret = ESP_OK;
+		int32_t sum = 0;
+		const size_t pos = static_cast<size_t>(in) - 1;
+		done = false;
+
+		ESP_GOTO_ON_ERROR(
+			analog_input_range(in, rng),
+			label_end, TAG, "Failed to analog_input_range!");
+
+		ESP_GOTO_ON_ERROR(
+			analog_inputs_enable(),
+			label_end, TAG, "Failed to analog_inputs_enable!");
+
+		ESP_GOTO_ON_ERROR(
+			expanders_wait(BIT(pos)),
+			label_end, TAG, "Failed to expanders_wait!");
+
+		vTaskDelay(cal_settle);
+
+		ESP_GOTO_ON_ERROR(
+			analog_input_read(in, cal_capture_reps, sum),
+			label_end, TAG, "Failed to analog_input_read!");
+
+		nominal = bin_to_phy_nominal<float>(in, rng, sum, cal_capture_reps);
+
+		// references closer than a code apart give no gain
+		if (cal_capture.in == in && cal_capture.rng == rng && std::fabs(nominal - cal_capture.nominal) > nominal_scale(pos, static_cast<size_t>(rng)))
+		{
+			CalPoint &p = calibration.in[pos][static_cast<size_t>(rng)];
+			CalPoint np;
+			np.gain = (ref - cal_capture.ref) / (nominal - cal_capture.nominal);
+			np.offset = ref - np.gain * nominal;
+
+			ESP_GOTO_ON_FALSE(
+				std::isfinite(np.gain) && std::isfinite(np.offset) && np.gain > 0,
+				ESP_ERR_INVALID_RESPONSE, label_end, TAG, "Captured references give no usable gain!");
+
+			p = np;
+			calibration_fold();
+			cal_capture = CalCapture();
+			done = true;
+			ESP_LOGI(TAG, "Calibrated input %" PRIu8 " range %" PRIu8 ": gain %f, offset %f", static_cast<uint8_t>(in), static_cast<uint8_t>(rng), p.gain, p.offset);
+		}
+		else // first point, or the same reading again
+			cal_capture = {in, rng, ref, nominal};
+
+	label_end:
+		port_cleanup();
+		expanders_wait(0b1111);
+
+		data_mutex.unlock();
+		return ret;
+	}
+
+	esp_err_t get_run_stats(RunStats &rs)
+	{
+#if SYNC_COLLECT_STATS
+		if (Communicator::is_running() || !data_mutex.try_lock())
+			return ESP_ERR_INVALID_STATE;
+
+		rs = run_stats;
+
+		data_mutex.unlock();
+		return ESP_OK;
+#else
+		return ESP_ERR_NOT_SUPPORTED;
+#endif
+	}
+
 	esp_err_t test()
 	{
 		return ESP_OK;
@@ -18,6 +18,13 @@ namespace Communicator
 		// SETTINGS
 		size_t time_bytes = 0;
 		size_t res_wrt_4b = 0;
+		bool raw_mode = false;
+
+		// RAW PACKING
+		bool code_pending = false;
+		uint16_t pending_code = 0;
+		int64_t pending_time = 0;
+		uint32_t codes_written = 0;
 	}
 
 	//================================//
@@ -31,6 +38,8 @@ namespace Communicator
 	esp_err_t cleanup()
 	{
 		bipbuf.clear();
+		code_pending = false;
+		codes_written = 0;
 		please_exit.store(false, std::memory_order::relaxed);
 		producer_running.store(false, std::memory_order::relaxed);
 		return ESP_OK;
@@ -61,6 +70,71 @@ namespace Communicator
 		return ESP_OK;
 	}
 
+	esp_err_t raw_settings(bool r)
+	{
+		raw_mode = r;
+		return ESP_OK;
+	}
+
+	bool is_raw()
+	{
+		return raw_mode;
+	}
+
+	bool write_code(const int64_t &time, uint16_t code)
+	{
+		if (!code_pending)
+		{
+			pending_code = code;
+			pending_time = time;
+			code_pending = true;
+			++codes_written;
+			return true;
+		}
+
+		const size_t res_wrt_pair = 3 + 2 * time_bytes;
+		etl::span<char> rsvd = bipbuf.write_reserve_optimal(res_wrt_pair);
+
+		if (rsvd.size() < res_wrt_pair) [[unlikely]]
+		{
+			ESP_LOGE(TAG, "Failed to reserve space for buffer writing!");
+			return false;
+		}
+
+		rsvd[0] = pending_code;
+		rsvd[1] = (pending_code >> 8 & 0x0F) | (code << 4 & 0xF0);
+		rsvd[2] = code >> 4;
+
+		std::copy(reinterpret_cast<const char *>(&pending_time),
+				  reinterpret_cast<const char *>(&pending_time) + time_bytes,
+				  rsvd.data() + 3);
+
+		std::copy(reinterpret_cast<const char *>(&time),
+				  reinterpret_cast<const char *>(&time) + time_bytes,
+				  rsvd.data() + 3 + time_bytes);
+
+		bipbuf.write_commit(rsvd.first(res_wrt_pair));
+
+		code_pending = false;
+		++codes_written;
+		return true;
+	}
+
+	bool flush_codes()
+	{
+		if (!code_pending)
+			return true;
+		if (!write_code(0, 0)) [[unlikely]]
+			return false;
+		--codes_written; // the padding is not a sample
+		return true;
+	}
+
+	uint32_t code_count()
+	{
+		return codes_written;
+	}
+
 	bool write_4bytes(const int64_t &time, const uint32_t &val)
 	{
 		etl::span<char> rsvd = bipbuf.write_reserve_optimal(res_wrt_4b);
@@ -86,6 +160,43 @@ namespace Communicator
 		return true;
 	}
 
+	bool write_frame(const int64_t &time, etl::span<const char> payload)
+	{
+		const size_t res_wrt_frame = payload.size() + time_bytes;
+		etl::span<char> rsvd = bipbuf.write_reserve_optimal(res_wrt_frame);
+
+		if (rsvd.size() < res_wrt_frame) [[unlikely]]
+		{
+			ESP_LOGE(TAG, "Failed to reserve space for buffer writing!");
+			return false;
+		}
+
+		std::copy(payload.begin(), payload.end(), rsvd.data());
+
+		std::copy(reinterpret_cast<const char *>(&time),
+				  reinterpret_cast<const char *>(&time) + time_bytes,
+				  rsvd.data() + payload.size());
+
+		bipbuf.write_commit(rsvd.first(res_wrt_frame));
+		return true;
+	}
+
+	bool write_bytes(etl::span<const char> data)
+	{
+		etl::span<char> rsvd = bipbuf.write_reserve_optimal(data.size());
+
+		if (rsvd.size() < data.size()) [[unlikely]]
+		{
+			ESP_LOGE(TAG, "Failed to reserve space for buffer writing!");
+			return false;
+		}
+
+		std::copy(data.begin(), data.end(), rsvd.data());
+
+		bipbuf.write_commit(rsvd.first(data.size()));
+		return true;
+	}
+
 	etl::span<char> get_read()
 	{
 		current_read = bipbuf.read_reserve();
@@ -108,6 +219,11 @@ namespace Communicator
 		return !bipbuf.empty();
 	}
 
+	size_t available()
+	{
+		return bipbuf.available();
+	}
+
 	void start_running()
 	{
 		producer_running.store(true, std::memory_order::relaxed);
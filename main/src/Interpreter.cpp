@@ -1,11 +1,12 @@
 #include "Interpreter.h"
 
 #include <cmath>
-// #include <array>
+#include <array>
 #include <stack>
-
-#include "to_integer.h"
-#include "to_floating_point.h"
+#include <algorithm>
+#include <charconv>
+#include <cerrno>
+#include <cstdlib>
 
 using namespace std::string_literals;
 
@@ -14,7 +15,7 @@ using namespace std::string_literals;
 #define PARSE_ERR(reason)                                                \
 	do                                                                   \
 	{                                                                    \
-		prgValid = false;                                                \
+		prg.prgValid = false;                                            \
 		err.push_back("Stmt #"s + std::to_string(line) + ": " + reason); \
 	} while (0)
 
@@ -22,9 +23,11 @@ static const char *expstx = "expected syntax: ";
 
 #define PARSE_ERR_SNTX(syntax) PARSE_ERR(expstx + syntax)
 
-static std::vector<std::string> str_split_on_whitespace(const std::string &str)
+// Splits into at most out.size() tokens, returns the total count of tokens found
+template <size_t N>
+static size_t str_split_on_whitespace(std::string_view str, std::array<std::string_view, N> &out)
 {
-	std::vector<std::string> ret;
+	size_t cnt = 0;
 
 	size_t i = 0;
 	size_t j = 0;
@@ -32,26 +35,77 @@ static std::vector<std::string> str_split_on_whitespace(const std::string &str)
 
 	while (j < l)
 	{
-		while (i < l && std::isspace(str[i]))
+		while (i < l && std::isspace(static_cast<unsigned char>(str[i])))
 			++i;
 
 		j = i;
 
-		while (j < l && !std::isspace(str[j]))
+		while (j < l && !std::isspace(static_cast<unsigned char>(str[j])))
 			++j;
 
 		if (i != j)
-			ret.push_back(str.substr(i, j - i));
+		{
+			if (cnt < N)
+				out[cnt] = str.substr(i, j - i);
+			++cnt;
+		}
 
 		i = j;
 	}
 
-	return ret;
+	return cnt;
 }
 
 namespace Interpreter
 {
-	static bool try_parse_range(const std::string &arg, uint32_t &val)
+	// base 0 detects the C prefixes like strtol does: 0x - hex, 0 - oct, else dec
+	template <typename T>
+	static bool try_parse_integer(std::string_view arg, T &val, int base = 10)
+	{
+		if (base == 0)
+		{
+			if (arg.size() > 2 && arg[0] == '0' && (arg[1] == 'x' || arg[1] == 'X'))
+			{
+				arg.remove_prefix(2);
+				base = 16;
+			}
+			else if (arg.size() > 1 && arg[0] == '0')
+			{
+				arg.remove_prefix(1);
+				base = 8;
+			}
+			else
+				base = 10;
+		}
+
+		const char *end = arg.data() + arg.size();
+		auto [ptr, ec] = std::from_chars(arg.data(), end, val, base);
+		return ec == std::errc() && ptr == end;
+	}
+
+	// Float from_chars is not available on every toolchain we build with, strtof on a stack copy instead
+	static bool try_parse_floating_point(std::string_view arg, float &val)
+	{
+		char buf[max_stmt_len + 1];
+
+		if (arg.empty() || arg.size() > max_stmt_len)
+			return false;
+
+		std::copy(arg.begin(), arg.end(), buf);
+		buf[arg.size()] = '\0';
+
+		char *end;
+		errno = 0;
+		float ans = std::strtof(buf, &end);
+
+		if (end != buf + arg.size() || errno == ERANGE)
+			return false;
+
+		val = ans;
+		return true;
+	}
+
+	static bool try_parse_range(std::string_view arg, uint32_t &val)
 	{
 		if (arg == "OFF")
 			val = 0;
@@ -67,238 +121,1088 @@ namespace Interpreter
 		return true;
 	}
 
-#include "InterpreterLUT.h"
+	static bool try_parse_cic(std::string_view decim, std::string_view order, uint32_t &val)
+	{
+		uint32_t d, o;
+		if (!try_parse_integer(decim, d) || !try_parse_integer(order, o) || d > cic_max_decim || o > cic_max_order)
+			return false;
+
+		val = cic_arg(d, o);
+		return cic_valid(val);
+	}
 
-	// Scope
-	InstrPtr Scope::getInstr() const
+	static bool try_parse_dual(std::string_view gen1, std::string_view gen2, uint32_t &val)
 	{
-		if (finished()) [[unlikely]] // never
-			return nullinstr;
+		uint32_t g1, g2;
+		if (!try_parse_integer(gen1, g1) || !try_parse_integer(gen2, g2) || g1 > dual_max_gen || g2 > dual_max_gen)
+			return false;
 
-		const Statement &stmt = statements[index];
+		val = dual_arg(g1, g2);
+		return true;
+	}
 
-		switch (stmt.index()) // check type
-		{
-		case 1: // cmd
-		{
-			++index;
-			return &std::get<Instruction>(stmt);
-		}
-		case 2: // loop
+#include "InterpreterLUT.h"
+
+	static_assert([]()
+				  {
+					  for (size_t i = 0; i < cs_lut_sz; ++i)
+						  if (static_cast<size_t>(CS_LUT[i].opc) != i || !CS_LUT[i].checker)
+							  return false;
+					  return true; }(),
+				  "CS_LUT rows must be in OPCode order and have a checker!");
+
+	// Perfect hash of mnemonics, seed is searched at compile time
+	constexpr size_t cs_hash_sz = 64;
+
+	static constexpr uint32_t mnemonic_hash(std::string_view str, uint32_t seed)
+	{
+		uint32_t h = seed; // FNV-1a
+		for (char c : str)
+			h = (h ^ static_cast<uint8_t>(c)) * 16777619u;
+		return (h ^ (h >> 16)) & (cs_hash_sz - 1);
+	}
+
+	constexpr uint32_t cs_hash_seed = []()
+	{
+		for (uint32_t seed = 2166136261u;; ++seed)
 		{
-			const Loop &loop = *std::get<LoopPtr>(stmt);
-			InstrPtr ret = loop.getInstr();
-			if (loop.finished())
+			std::array<bool, cs_hash_sz> used = {};
+			bool ok = true;
+			for (const InstrLUTRow &row : CS_LUT)
 			{
-				++index;
-				loop.restart();
+				uint32_t h = mnemonic_hash(row.namestr, seed);
+				if (used[h])
+				{
+					ok = false;
+					break;
+				}
+				used[h] = true;
 			}
-			return ret;
-		}
-		default:
-			return nullinstr;
+			if (ok)
+				return seed;
 		}
-	}
+	}();
+
+	// Slot -> CS_LUT index + 1, 0 means empty
+	constexpr std::array<uint8_t, cs_hash_sz> cs_hash_lut = []()
+	{
+		std::array<uint8_t, cs_hash_sz> ret = {};
+		for (size_t i = 0; i < cs_lut_sz; ++i)
+			ret[mnemonic_hash(CS_LUT[i].namestr, cs_hash_seed)] = i + 1;
+		return ret;
+	}();
 
-	bool Scope::finished() const
+	static const InstrLUTRow *find_instr(std::string_view cmd)
 	{
-		return index >= statements.size();
+		uint8_t idx = cs_hash_lut[mnemonic_hash(cmd, cs_hash_seed)];
+		if (idx == 0 || cmd != CS_LUT[idx - 1].namestr)
+			return nullptr;
+		return &CS_LUT[idx - 1];
 	}
-	void Scope::reset() const
+
+	// Program
+
+	InstrPtr Program::getInstr() const
 	{
-		index = 0;
-		for (const Statement &stmt : statements)
+		while (pc < prg_code.size()) [[likely]]
 		{
-			switch (stmt.index()) // check type
+			const Instruction &instr = prg_code[pc];
+
+			switch (instr.opc)
 			{
-			case 2:
+			case OPCode::LOOP:
 			{
-				Loop &loop = *std::get<LoopPtr>(stmt);
-				loop.reset();
-				break;
+				const LoopDesc &loop = prg_loops[instr.arg.u];
+				loop.iter = 0;
+				pc = (loop.max_iter != 0) ? pc + 1 : loop.end + 1;
+				continue;
+			}
+			case OPCode::END:
+			{
+				const LoopDesc &loop = prg_loops[instr.arg.u];
+				if (++loop.iter < loop.max_iter) [[likely]]
+				{
+					pc = loop.begin + 1;
+					if (stop_cb && stop_cb()) [[unlikely]] // a back-edge, long running loops may have no sync point
+						pc = prg_code.size();
+				}
+				else
+					++pc;
+				continue;
 			}
 			default:
-				break;
+				++pc;
+				return &instr;
 			}
 		}
+		return nullinstr;
 	}
-	void Scope::restart() const
+	size_t Program::index_of(InstrPtr instr) const
 	{
-		index = 0;
+		return instr - prg_code.data();
 	}
 
-	Instruction &Scope::appendInstr(const Instruction &c)
+	void Program::reset(StopCb stop) const
 	{
-		statements.emplace_back(std::in_place_type<Instruction>, c);
-		return std::get<Instruction>(statements.back());
+		pc = 0;
+		stop_cb = stop;
+		for (const LoopDesc &loop : prg_loops)
+			loop.iter = 0;
 	}
 
-	Loop &Scope::appendLoop(size_t iters)
+	bool Program::poll_stop() const
 	{
-		statements.emplace_back(std::in_place_type<LoopPtr>, std::make_unique<Loop>(iters));
-		return *std::get<LoopPtr>(statements.back());
+		if (!stop_cb || !stop_cb())
+			return false;
+		pc = prg_code.size();
+		return true;
 	}
 
-	size_t Scope::size() const
+	size_t Program::size() const
 	{
-		return statements.size();
+		return prg_code.size();
 	}
 
-	// Loop
-
-	Loop::Loop(size_t mi) : max_iter(mi) {}
-	Loop::~Loop() = default;
+	etl::span<const Instruction> Program::instructions() const
+	{
+		return prg_code;
+	}
 
-	InstrPtr Loop::getInstr() const
+	size_t Program::loop_count() const
 	{
-		if (finished()) [[unlikely]] // never
-			return nullinstr;
+		return prg_loops.size();
+	}
 
-		InstrPtr ret = scope.getInstr();
+	size_t Program::bytes() const
+	{
+		return prg_code.size_bytes() + prg_loops.size_bytes() + prg_steps.size_bytes();
+	}
 
-		if (scope.finished())
-		{
-			++iter;
-			scope.restart();
-		}
+	// Steps
 
-		return ret;
+	static bool is_step(OPCode opc)
+	{
+		return opc == OPCode::AOSTEP || opc == OPCode::DELAYSTEP;
 	}
 
-	bool Loop::finished() const
+	static bool step_valid(OPCode opc, const StepDesc &sd)
 	{
-		return iter >= max_iter;
+		if (!std::isfinite(sd.start) || !std::isfinite(sd.step))
+			return false;
+		if (opc == OPCode::DELAYSTEP)
+			return sd.start >= 0 && sd.step > 0;
+		return true;
 	}
-	void Loop::reset() const
+
+	static inline float step_eval(OPCode opc, const StepDesc &sd, uint32_t iter)
 	{
-		iter = 0;
-		scope.reset();
+		if (opc == OPCode::DELAYSTEP)
+			return sd.start * std::pow(sd.step, static_cast<float>(iter));
+		return sd.start + sd.step * static_cast<float>(iter);
 	}
-	void Loop::restart() const
+
+	// Fixed instruction for a step at a known iteration, for unrolled loops
+	static Instruction step_resolve(const Instruction &instr, const StepDesc &sd, uint32_t iter)
 	{
-		iter = 0;
+		Instruction ret;
+		ret.port = instr.port;
+		float val = step_eval(instr.opc, sd, iter);
+		if (instr.opc == OPCode::DELAYSTEP)
+			ret.opc = OPCode::DELAY, ret.arg.u = delay_round(val);
+		else
+			ret.opc = OPCode::AOVAL, ret.arg.f = val;
+		return ret;
 	}
 
-	Scope &Loop::getScope()
+	float Program::step_value(const Instruction &instr) const
 	{
-		return scope;
+		const StepDesc &sd = prg_steps[instr.arg.u];
+		return step_eval(instr.opc, sd, prg_loops[sd.loop].iter);
 	}
 
-	//
+	// Storage
 
-	// Program
+	void Program::clear()
+	{
+		code.clear();
+		loops.clear();
+		steps.clear();
+		arena.reset();
+		prg_code = {};
+		prg_loops = {};
+		prg_steps = {};
+		pc = 0;
+		stop_cb = nullptr;
+	}
 
-	InstrPtr Program::getInstr() const
+	Program::Program(Program &&rhs)
 	{
-		if (scope.finished()) [[unlikely]]
-			return nullinstr;
-		return scope.getInstr();
+		*this = std::move(rhs);
 	}
-	void Program::reset() const
+
+	Program &Program::operator=(Program &&rhs)
 	{
-		scope.reset();
+		if (this == &rhs)
+			return *this;
+
+		code = std::move(rhs.code);
+		loops = std::move(rhs.loops);
+		steps = std::move(rhs.steps);
+		arena = std::move(rhs.arena);
+		prg_code = rhs.prg_code;
+		prg_loops = rhs.prg_loops;
+		prg_steps = rhs.prg_steps;
+		pc = rhs.pc;
+		stop_cb = rhs.stop_cb;
+		prgValid = rhs.prgValid;
+
+		rhs.clear();
+		rhs.prgValid = true; // as default constructed
+		return *this;
 	}
 
-	size_t Program::size() const
+	// Moves the scratch vectors into one exactly sized block
+	void Program::pack()
 	{
-		return scope.size();
+		static_assert(sizeof(Instruction) % alignof(LoopDesc) == 0, "LoopDescs must stay aligned after the code!");
+		static_assert(sizeof(LoopDesc) % alignof(StepDesc) == 0, "StepDescs must stay aligned after the loops!");
+
+		size_t code_bytes = code.size() * sizeof(Instruction);
+		size_t loops_bytes = loops.size() * sizeof(LoopDesc);
+		size_t total = code_bytes + loops_bytes + steps.size() * sizeof(StepDesc);
+
+		arena.reset(total ? new std::byte[total] : nullptr);
+
+		Instruction *c = reinterpret_cast<Instruction *>(arena.get());
+		LoopDesc *l = reinterpret_cast<LoopDesc *>(arena.get() + code_bytes);
+		StepDesc *st = reinterpret_cast<StepDesc *>(arena.get() + code_bytes + loops_bytes);
+		std::uninitialized_copy(code.begin(), code.end(), c);
+		std::uninitialized_copy(loops.begin(), loops.end(), l);
+		std::uninitialized_copy(steps.begin(), steps.end(), st);
+
+		prg_code = etl::span<const Instruction>(c, code.size());
+		prg_loops = etl::span<const LoopDesc>(l, loops.size());
+		prg_steps = etl::span<const StepDesc>(st, steps.size());
+
+		std::vector<Instruction>().swap(code);
+		std::vector<LoopDesc>().swap(loops);
+		std::vector<StepDesc>().swap(steps);
+	}
+
+	void Program::unpack()
+	{
+		code.assign(prg_code.begin(), prg_code.end());
+		loops.assign(prg_loops.begin(), prg_loops.end());
+		steps.assign(prg_steps.begin(), prg_steps.end());
+
+		arena.reset();
+		prg_code = {};
+		prg_loops = {};
+		prg_steps = {};
 	}
 
 	// Parser
 
-	bool Program::parse(const std::string &str, std::vector<std::string> &err)
+	Program::Parser::Parser(Program &p, std::vector<std::string> &e) : prg(p), err(e)
 	{
-		prgValid = true;
+		prg.prgValid = true;
+		prg.clear();
 
-		std::stack<Scope *, std::vector<Scope *>> scopes; // underlying storage type
-		scopes.push(&scope);							  // main
+		carry.reserve(max_stmt_len);
+	}
 
+	void Program::Parser::feed(std::string_view str)
+	{
 		size_t beg = 0;
-		size_t end = 0;
-		size_t line = 0;
 
 		while (beg < str.length())
 		{
-			++line;
-
-			end = str.find(';', beg);
-			if (end == std::string::npos)
+			size_t end = str.find(';', beg);
+			bool terminated = end != std::string_view::npos;
+			if (!terminated)
 				end = str.length();
 
-			if (end - beg > 32) // sanity check
+			std::string_view part = str.substr(beg, end - beg);
+			beg = end + 1;
+
+			if (!overlong && carry.length() + part.length() > max_stmt_len) // sanity check
+				overlong = true;
+			else if (!overlong)
+				carry.append(part);
+
+			if (terminated)
+				flush();
+		}
+	}
+
+	bool Program::Parser::finish()
+	{
+		if (overlong || !carry.empty()) // last statement without ';'
+			flush();
+
+		line = -1;
+		for (size_t i = 0; i < scopes.size(); ++i)
+			PARSE_ERR("Scope has not been terminated (missing END)!");
+
+		prg.pack();
+		return prg.prgValid;
+	}
+
+	void Program::Parser::flush()
+	{
+		++line;
+
+		if (overlong)
+			PARSE_ERR("malformed (too long, max 32)!");
+		else
+			statement(carry);
+
+		carry.clear();
+		overlong = false;
+	}
+
+	void Program::Parser::statement(std::string_view stmtstr)
+	{
+		std::vector<Instruction> &code = prg.code;
+		std::vector<LoopDesc> &loops = prg.loops;
+		std::vector<StepDesc> &steps = prg.steps;
+
+		std::array<std::string_view, 1 + max_args> tokens;
+		ParseArgs args;
+
+		size_t tokcnt = str_split_on_whitespace(stmtstr, tokens); // split and strip WSs
+
+		if (tokcnt == 0) // no command
+			return;
+
+		std::string_view cmd = tokens[0];
+		size_t argcnt = tokcnt - 1;
+		std::copy(tokens.begin() + 1, tokens.end(), args.begin());
+
+		const InstrLUTRow *lut = find_instr(cmd);
+		OPCode opc = lut ? lut->opc : OPCode::INV;
+
+		if (opc == OPCode::LOOP)
+		{
+			uint32_t iters = 0;
+
+			if (argcnt != 1 || !try_parse_integer(args[0], iters))
+				PARSE_ERR_SNTX("LOOP <iterations (uint32)>");
+
+			Instruction cs;
+			cs.opc = OPCode::LOOP;
+			cs.arg.u = loops.size();
+
+			LoopDesc &l = loops.emplace_back();
+			l.max_iter = iters;
+			l.begin = code.size();
+
+			code.push_back(cs);
+			scopes.push(cs.arg.u);
+		}
+		else if (opc == OPCode::END)
+		{
+			if (argcnt != 0)
+				PARSE_ERR_SNTX("END <no args>");
+
+			if (scopes.empty())
 			{
-				beg = end + 1;
-				PARSE_ERR("malformed (too long, max 32)!");
-				continue;
+				PARSE_ERR("END: no Scope to end!");
+				return;
 			}
 
-			std::string stmtstr = str.substr(beg, end - beg);
-			beg = end + 1;
+			Instruction cs;
+			cs.opc = OPCode::END;
+			cs.arg.u = scopes.top();
 
-			std::vector<std::string> args = str_split_on_whitespace(stmtstr); // split and strip WSs
+			loops[cs.arg.u].end = code.size();
 
-			if (args.empty()) // no command
-				continue;
+			code.push_back(cs);
+			scopes.pop();
+		}
+		else if (is_step(opc))
+		{
+			Instruction cs;
+			cs.opc = opc;
+
+			StepDesc sd;
+			size_t a = 0;
+			bool ok = argcnt == lut->argcnt;
 
-			std::string cmd = std::move(args[0]);
-			args.erase(args.begin());
+			if (ok && opc == OPCode::AOSTEP)
+				ok = try_parse_integer(args[a++], cs.port) && lut->checker(cs);
+			ok = ok && try_parse_floating_point(args[a], sd.start) && try_parse_floating_point(args[a + 1], sd.step) && step_valid(opc, sd);
 
-			if (cmd == "LOOP")
+			if (!ok)
+				PARSE_ERR_SNTX(lut->namestr + ' ' + lut->argstr);
+			else if (scopes.empty())
+				PARSE_ERR("step must be inside of a Scope!");
+			else
 			{
-				size_t iters = 0;
+				sd.loop = scopes.top();
+				cs.arg.u = steps.size();
+				steps.push_back(sd);
+				code.push_back(cs);
+			}
+		}
+		//*/
+		else // regular command
+		{
+			Instruction cs;
 
-				if (args.size() != 1 || !try_parse_integer(args[0], iters))
-					PARSE_ERR_SNTX("LOOP <iterations (uint32)>");
+			if (lut)
+			{
+				cs.opc = lut->opc;
 
-				Loop &l = scopes.top()->appendLoop(iters);
-				scopes.push(&l.getScope());
+				if (!lut->parser)
+					PARSE_ERR("command has no arg parser!");
+				else if ((argcnt != lut->argcnt) || !lut->parser(args, cs))
+					PARSE_ERR_SNTX(lut->namestr + ' ' + lut->argstr);
 			}
-			else if (cmd == "END")
+
+			if (cs.opc == OPCode::NOP || cs.opc == OPCode::INV)
+				PARSE_ERR("invalid command!");
+			else
+				code.push_back(cs);
+		}
+	}
+
+	bool Program::parse(std::string_view str, std::vector<std::string> &err)
+	{
+		Parser p(*this, err);
+		code.reserve(std::count(str.begin(), str.end(), ';') + 1); // upper bound, one allocation
+		p.feed(str);
+		return p.finish();
+	}
+
+	// Binary format
+
+	static constexpr std::array<uint32_t, 256> crc32_lut = []()
+	{
+		std::array<uint32_t, 256> ret = {};
+		for (uint32_t i = 0; i < 256; ++i)
+		{
+			uint32_t c = i;
+			for (size_t b = 0; b < 8; ++b)
+				c = (c & 1) ? (0xEDB88320 ^ (c >> 1)) : (c >> 1);
+			ret[i] = c;
+		}
+		return ret;
+	}();
+
+	static uint32_t crc32_update(uint32_t crc, const char *data, size_t len)
+	{
+		for (size_t i = 0; i < len; ++i)
+			crc = crc32_lut[(crc ^ static_cast<uint8_t>(data[i])) & 0xFF] ^ (crc >> 8);
+		return crc;
+	}
+
+	template <typename T>
+	static T get_le(const char *p)
+	{
+		T ret = 0;
+		for (size_t i = 0; i < sizeof(T); ++i)
+			ret |= static_cast<T>(static_cast<uint8_t>(p[i])) << (8 * i);
+		return ret;
+	}
+
+	template <typename T>
+	static void put_le(std::string &out, T val)
+	{
+		for (size_t i = 0; i < sizeof(T); ++i)
+			out.push_back(static_cast<char>(val >> (8 * i)));
+	}
+
+	// Pulls exact-sized chunks from the reader, keeps a running CRC
+	class BinStream
+	{
+		const ReadCb &read;
+		std::array<char, 256> buf;
+		size_t len = 0;
+		size_t pos = 0;
+
+	public:
+		uint32_t crc = 0xFFFFFFFF;
+
+		BinStream(const ReadCb &r) : read(r) {}
+
+		bool get(char *dst, size_t n, bool checksum = true)
+		{
+			char *const beg = dst;
+			while (n)
 			{
-				if (args.size() != 0)
-					PARSE_ERR_SNTX("END <no args>");
+				if (pos == len)
+				{
+					int ret = read(buf.data(), buf.size());
+					if (ret <= 0)
+						return false;
+					len = ret;
+					pos = 0;
+				}
+				size_t cnt = std::min(n, len - pos);
+				std::copy_n(buf.data() + pos, cnt, dst);
+				pos += cnt;
+				dst += cnt;
+				n -= cnt;
+			}
+			if (checksum)
+				crc = crc32_update(crc, beg, dst - beg);
+			return true;
+		}
+	};
 
-				if (scopes.size() == 1)
-					PARSE_ERR("END: no Scope to end!");
+	bool Program::load(const ReadCb &read, size_t total, std::vector<std::string> &err)
+	{
+		clear();
+		bool ret = load_code(read, total, err);
+		pack();
+		return ret;
+	}
+
+	bool Program::load_code(const ReadCb &read, size_t total, std::vector<std::string> &err)
+	{
+#define LOAD_ERR(reason)                     \
+	do                                       \
+	{                                        \
+		prgValid = false;                    \
+		err.push_back("Binary: "s + reason); \
+		return false;                        \
+	} while (0)
+
+		prgValid = true;
+
+		BinStream in(read);
+		std::array<char, bin_header_sz> hdr;
+
+		if (total < bin_header_sz + bin_trailer_sz || !in.get(hdr.data(), hdr.size()))
+			LOAD_ERR("truncated header!");
+
+		if (get_le<uint32_t>(&hdr[0]) != bin_magic)
+			LOAD_ERR("bad magic!");
+		if (get_le<uint16_t>(&hdr[4]) != bin_version || get_le<uint16_t>(&hdr[6]) != 0)
+			LOAD_ERR("unsupported version or flags!");
+
+		uint32_t count = get_le<uint32_t>(&hdr[8]);
+		if (total != bin_header_sz + bin_record_sz * size_t(count) + bin_trailer_sz) // before reserving anything
+			LOAD_ERR("size does not match instruction count!");
+
+		code.reserve(count);
+		std::stack<size_t, std::vector<size_t>> scopes; // indices of open LoopDescs
 
+		std::array<char, bin_record_sz> rec;
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			if (!in.get(rec.data(), rec.size()))
+				LOAD_ERR("truncated at instr #" + std::to_string(i) + "!");
+
+			uint8_t opc = rec[0];
+			if (opc >= cs_lut_sz)
+				LOAD_ERR("instr #" + std::to_string(i) + " has unknown opcode!");
+
+			Instruction cs;
+			cs.opc = CS_LUT[opc].opc;
+			cs.port = rec[1];
+			cs.arg.u = get_le<uint32_t>(&rec[2]);
+
+			if (!CS_LUT[opc].checker(cs))
+				LOAD_ERR("instr #" + std::to_string(i) + " has invalid args, expected syntax: " + CS_LUT[opc].namestr + ' ' + CS_LUT[opc].argstr);
+
+			if (cs.opc == OPCode::LOOP)
+			{
+				LoopDesc &l = loops.emplace_back();
+				l.max_iter = cs.arg.u;
+				l.begin = code.size();
+
+				cs.port = 0;
+				cs.arg.u = loops.size() - 1;
+				scopes.push(cs.arg.u);
+			}
+			else if (cs.opc == OPCode::END)
+			{
+				if (scopes.empty())
+					LOAD_ERR("instr #" + std::to_string(i) + ": END has no Scope to end!");
+
+				cs.port = 0;
+				cs.arg.u = scopes.top();
+				loops[cs.arg.u].end = code.size();
 				scopes.pop();
 			}
-			//*/
-			else // regular command
+			else if (is_step(cs.opc))
+			{
+				if (++i < count && !in.get(rec.data(), rec.size()))
+					LOAD_ERR("truncated at instr #" + std::to_string(i) + "!");
+				if (i >= count || rec[0] != static_cast<char>(OPCode::NOP))
+					LOAD_ERR("instr #" + std::to_string(i) + " must be the step of the preceding instr!");
+
+				Instruction par; // step travels in the arg of the NOP record
+				par.arg.u = get_le<uint32_t>(&rec[2]);
+
+				StepDesc sd;
+				sd.start = cs.arg.f;
+				sd.step = par.arg.f;
+
+				if (!step_valid(cs.opc, sd))
+					LOAD_ERR("instr #" + std::to_string(i) + " has invalid step args!");
+				if (scopes.empty())
+					LOAD_ERR("instr #" + std::to_string(i) + ": step must be inside of a Scope!");
+
+				sd.loop = scopes.top();
+				cs.arg.u = steps.size();
+				steps.push_back(sd);
+			}
+
+			code.push_back(cs);
+		}
+
+		if (!scopes.empty())
+			LOAD_ERR("Scope has not been terminated (missing END)!");
+
+		std::array<char, bin_trailer_sz> crc;
+		if (!in.get(crc.data(), crc.size(), false))
+			LOAD_ERR("truncated CRC!");
+		if (get_le<uint32_t>(crc.data()) != ~in.crc)
+			LOAD_ERR("CRC mismatch!");
+
+		return prgValid;
+#undef LOAD_ERR
+	}
+
+	void Program::encode(std::string &out) const
+	{
+		size_t count = prg_code.size() + prg_steps.size(); // each step needs a 2nd record
+
+		out.clear();
+		out.reserve(bin_header_sz + bin_record_sz * count + bin_trailer_sz);
+
+		put_le<uint32_t>(out, bin_magic);
+		put_le<uint16_t>(out, bin_version);
+		put_le<uint16_t>(out, 0);
+		put_le<uint32_t>(out, count);
+
+		auto record = [&out](OPCode opc, uint8_t port, uint32_t arg)
+		{
+			out.push_back(static_cast<char>(opc));
+			out.push_back(static_cast<char>(port));
+			put_le<uint32_t>(out, arg);
+		};
+
+		for (const Instruction &cs : prg_code)
+		{
+			if (cs.opc == OPCode::LOOP)
+				record(cs.opc, cs.port, prg_loops[cs.arg.u].max_iter);
+			else if (cs.opc == OPCode::END)
+				record(cs.opc, cs.port, 0);
+			else if (is_step(cs.opc))
 			{
-				Instruction cs;
+				const StepDesc &sd = prg_steps[cs.arg.u];
+				Instruction par;
+				par.arg.f = sd.start;
+				record(cs.opc, cs.port, par.arg.u);
+				par.arg.f = sd.step;
+				record(OPCode::NOP, 0, par.arg.u);
+			}
+			else
+				record(cs.opc, cs.port, cs.arg.u);
+		}
 
-				for (const auto &lut : CS_LUT)
+		put_le<uint32_t>(out, ~crc32_update(0xFFFFFFFF, out.data(), out.size()));
+	}
+
+	// Optimizer
+
+	// Digital output op as per-bit transform: state = (state & keep) ^ flip
+	static bool digital_as_mask(const Instruction &instr, uint32_t &keep, uint32_t &flip)
+	{
+		constexpr uint32_t all = 0b1111;
+		const uint32_t v = instr.arg.u;
+
+		switch (instr.opc)
+		{
+		case OPCode::DOWR:
+			keep = 0, flip = v;
+			return true;
+		case OPCode::DOSET:
+			keep = all & ~v, flip = v;
+			return true;
+		case OPCode::DORST:
+			keep = all & ~v, flip = 0;
+			return true;
+		case OPCode::DOAND:
+			keep = v, flip = 0;
+			return true;
+		case OPCode::DOXOR:
+			keep = all, flip = v;
+			return true;
+		case OPCode::DOMSK:
+			keep = instr.port, flip = v;
+			return true;
+		default:
+			return false;
+		}
+	}
+
+	static Instruction digital_from_mask(uint32_t keep, uint32_t flip)
+	{
+		constexpr uint32_t all = 0b1111;
+
+		Instruction ret;
+		ret.arg.u = flip;
+
+		if (keep == 0)
+			ret.opc = OPCode::DOWR;
+		else if (keep == all)
+			ret.opc = OPCode::DOXOR;
+		else if ((keep | flip) == all && (keep & flip) == 0)
+			ret.opc = OPCode::DOSET;
+		else if (flip == 0)
+			ret.opc = OPCode::DOAND, ret.arg.u = keep;
+		else
+			ret.opc = OPCode::DOMSK, ret.port = keep;
+
+		return ret;
+	}
+
+	bool Program::optimize_loops()
+	{
+		std::vector<Instruction> out;
+		std::vector<bool> drop_end(code.size(), false);
+		std::vector<bool> flattened(loops.size(), false); // steps of these run at iteration 0 only
+		bool changed = false;
+
+		out.reserve(code.size());
+
+		for (size_t i = 0; i < code.size(); ++i)
+		{
+			const Instruction &instr = code[i];
+
+			if (instr.opc == OPCode::LOOP)
+			{
+				const LoopDesc &loop = loops[instr.arg.u];
+				const size_t body = loop.end - loop.begin - 1;
+
+				if (loop.max_iter == 0 || body == 0) // no-op
 				{
-					if (cmd == lut.namestr)
-					{
-						cs.opc = lut.opc;
+					changed = true;
+					i = loop.end;
+					continue;
+				}
+
+				if (loop.max_iter == 1) // body stays, may contain other loops
+				{
+					changed = true;
+					drop_end[loop.end] = true;
+					flattened[instr.arg.u] = true;
+					continue;
+				}
+
+				bool innermost = std::none_of(code.begin() + loop.begin + 1, code.begin() + loop.end,
+											  [](const Instruction &in)
+											  { return in.opc == OPCode::LOOP; });
+
+				if (innermost && static_cast<uint64_t>(loop.max_iter) * body <= unroll_max)
+				{
+					changed = true;
+					for (size_t r = 0; r < loop.max_iter; ++r)
+						for (size_t j = loop.begin + 1; j < loop.end; ++j)
+							out.push_back(is_step(code[j].opc) ? step_resolve(code[j], steps[code[j].arg.u], r) : code[j]);
+					i = loop.end;
+					continue;
+				}
+			}
+			else if (instr.opc == OPCode::END && drop_end[i])
+				continue;
+			else if (is_step(instr.opc) && flattened[steps[instr.arg.u].loop])
+			{
+				out.push_back(step_resolve(instr, steps[instr.arg.u], 0));
+				continue;
+			}
+
+			out.push_back(instr);
+		}
+
+		code.swap(out);
+		relink();
+		return changed;
+	}
+
+	void Program::optimize_peephole()
+	{
+		std::vector<Instruction> out;
+		out.reserve(code.size());
 
-						if (!lut.parser)
-						{
-							PARSE_ERR("command has no arg parser!");
-							break;
-						}
+		for (size_t i = 0; i < code.size(); ++i)
+		{
+			Instruction instr = code[i];
+			uint32_t keep, flip;
+
+			if (instr.opc == OPCode::DELAY)
+			{
+				while (i + 1 < code.size() && code[i + 1].opc == OPCode::DELAY &&
+					   static_cast<uint64_t>(instr.arg.u) + code[i + 1].arg.u <= UINT32_MAX)
+					instr.arg.u += code[++i].arg.u;
+			}
+			else if (instr.opc == OPCode::AOGEN && i + 1 < code.size() && code[i + 1].opc == OPCode::AOGEN && code[i + 1].port != instr.port &&
+					 instr.arg.u <= dual_max_gen && code[i + 1].arg.u <= dual_max_gen) // both outputs on the same tick
+			{
+				const Instruction &next = code[++i];
+				uint32_t gen1 = (instr.port == 1) ? instr.arg.u : next.arg.u;
+				uint32_t gen2 = (instr.port == 1) ? next.arg.u : instr.arg.u;
+				instr = Instruction();
+				instr.opc = OPCode::AODUAL;
+				instr.arg.u = dual_arg(gen1, gen2);
+			}
+			else if (digital_as_mask(instr, keep, flip))
+			{
+				uint32_t k, f;
+				bool fused = false;
+
+				while (i + 1 < code.size() && digital_as_mask(code[i + 1], k, f))
+				{
+					flip = (flip & k) ^ f;
+					keep &= k;
+					fused = true;
+					++i;
+				}
+
+				if (fused)
+					instr = digital_from_mask(keep, flip);
+			}
+
+			out.push_back(instr);
+		}
+
+		code.swap(out);
+		relink();
+	}
+
+	// Rebuilds LoopDescs and StepDescs after instructions moved, LOOP and steps must still point to their old desc
+	void Program::relink()
+	{
+		std::vector<LoopDesc> old;
+		old.swap(loops);
+		std::vector<StepDesc> old_steps;
+		old_steps.swap(steps);
+
+		std::stack<size_t, std::vector<size_t>> scopes;
+
+		for (size_t i = 0; i < code.size(); ++i)
+		{
+			Instruction &instr = code[i];
+
+			if (instr.opc == OPCode::LOOP)
+			{
+				LoopDesc &l = loops.emplace_back();
+				l.max_iter = old[instr.arg.u].max_iter;
+				l.begin = i;
+				instr.arg.u = loops.size() - 1;
+				scopes.push(instr.arg.u);
+			}
+			else if (instr.opc == OPCode::END)
+			{
+				instr.arg.u = scopes.top();
+				loops[instr.arg.u].end = i;
+				scopes.pop();
+			}
+			else if (is_step(instr.opc))
+			{
+				StepDesc &sd = steps.emplace_back(old_steps[instr.arg.u]);
+				sd.loop = scopes.top();
+				instr.arg.u = steps.size() - 1;
+			}
+		}
+	}
+
+	void Program::optimize()
+	{
+		if (!prgValid)
+			return;
+
+		unpack();
+
+		while (optimize_loops()) // unrolling may expose new tiny loops
+			;
 
-						if ((args.size() != lut.argcnt) || !lut.parser(args, cs))
-							PARSE_ERR_SNTX(lut.namestr + ' ' + lut.argstr);
+		optimize_peephole();
 
-						break;
+		pack();
+		pc = 0;
+	}
+
+	//----------------------------------------------------------------//
+
+	// Time is relative to the last sync point, which was scheduled at sched and reached lag late
+	struct Program::TimingState
+	{
+		double sched = 0;	 // scheduled time of the last sync point
+		double lag = 0;		 // how late the last sync point was reached
+		double pending = 0;	 // work done since the last sync point
+		bool waiting = false; // next I/O blocks on the alarm first
+		uint64_t records = 0;
+	};
+
+	static constexpr size_t max_warnings = 8;
+	static constexpr size_t analyze_full_max = 256; // loops with steps up to this many iterations are simulated fully
+
+	// At most one warning per instruction, loops would repeat them
+	static void add_warning(TimingReport &rep, size_t idx, const std::string &msg)
+	{
+		if (rep.warnings.size() >= max_warnings)
+			return;
+		std::string pfx = "Instr #"s + std::to_string(idx) + ": ";
+		for (const std::string &w : rep.warnings)
+			if (w.compare(0, pfx.size(), pfx) == 0)
+				return;
+		rep.warnings.push_back(pfx + msg);
+	}
+
+	void Program::analyze_range(size_t b, size_t e, const CostModel &cm, TimingState &st, TimingReport &rep) const
+	{
+		for (size_t i = b; i < e; ++i)
+		{
+			const Instruction &ins = prg_code[i];
+			const float cost = cm.base_us[static_cast<size_t>(ins.opc)];
+
+			switch (ins.opc)
+			{
+			case OPCode::LOOP:
+			{
+				const LoopDesc &ld = prg_loops[ins.arg.u];
+				const size_t iter = ld.max_iter;
+
+				bool stepped = std::any_of(prg_steps.begin(), prg_steps.end(),
+										   [&ins](const StepDesc &sd)
+										   { return sd.loop == ins.arg.u; });
+
+				if (stepped && iter <= analyze_full_max) // steps make iterations differ, simulate all of them
+				{
+					for (ld.iter = 0; ld.iter < iter; ++ld.iter)
+						analyze_range(ld.begin + 1, ld.end, cm, st, rep);
+					i = ld.end;
+					break;
+				}
+
+				// Two iterations are simulated, the rest is extrapolated from their difference
+				ld.iter = 0;
+				if (iter >= 1)
+					analyze_range(ld.begin + 1, ld.end, cm, st, rep);
+				if (iter >= 2)
+				{
+					TimingState s1 = st;
+					uint64_t o1 = rep.overruns;
+					ld.iter = 1;
+					analyze_range(ld.begin + 1, ld.end, cm, st, rep);
+
+					double n = iter - 2;
+					st.sched += n * (st.sched - s1.sched);
+					st.lag = std::max(0.0, st.lag + n * (st.lag - s1.lag));
+					st.pending = std::max(0.0, st.pending + n * (st.pending - s1.pending));
+					st.records += (iter - 2) * (st.records - s1.records);
+					rep.overruns += (iter - 2) * (rep.overruns - o1);
+					rep.max_lag_us = std::max(rep.max_lag_us, st.lag);
+				}
+				i = ld.end;
+				break;
+			}
+
+			case OPCode::DELAY:
+			case OPCode::DELAYSTEP:
+			{
+				const uint32_t delay = (ins.opc == OPCode::DELAY) ? ins.arg.u : delay_round(step_value(ins));
+				st.pending += cost;
+				double late = st.lag + st.pending - delay;
+				if (late > 0)
+				{
+					++rep.overruns;
+					if (late > rep.max_lag_us)
+					{
+						rep.max_lag_us = late;
+						rep.worst_instr = i;
 					}
+					add_warning(rep, i, "DELAY " + std::to_string(delay) + " us is too short, the work before it takes ~" + std::to_string(std::lround(st.pending)) + " us");
 				}
+				st.lag = std::max(0.0, late);
+				st.sched += delay;
+				st.pending = 0;
+				st.waiting = -late >= cm.spin_us; // else spun to
+				break;
+			}
 
-				if (cs.opc == OPCode::NOP || cs.opc == OPCode::INV)
-					PARSE_ERR("invalid command!");
-				else
-					scopes.top()->appendInstr(cs);
+			case OPCode::GETTM:
+			case OPCode::RSTTM:
+				// Timeline restarts from now, nothing is late anymore
+				st.sched += st.lag + st.pending + cost;
+				st.lag = 0;
+				st.pending = 0;
+				st.waiting = ins.opc == OPCode::GETTM && cm.spin_us <= 0; // due right away
+				break;
+
+			case OPCode::NOP:
+				break;
+
+			default:
+				if (st.waiting)
+				{
+					st.pending += cm.sync_us;
+					st.waiting = false;
+				}
+				st.pending += cost;
+				switch (ins.opc)
+				{
+				case OPCode::AIRDF:
+				case OPCode::AIRDM:
+				case OPCode::AIRDU:
+					st.pending += cm.per_rep_us * ins.arg.u;
+					[[fallthrough]];
+				case OPCode::DIRD:
+					++st.records;
+					break;
+				case OPCode::AIRDC:
+					st.pending += cm.per_rep_us * cic_decim(ins.arg.u);
+					++st.records;
+					break;
+				case OPCode::AIRDB:
+				{
+					size_t nch = __builtin_popcount(ins.port);
+					st.pending += cm.per_rep_us * ins.arg.u * nch;
+					st.records += nch;
+					break;
+				}
+				default:
+					break;
+				}
+				break;
 			}
 		}
+	}
+
+	bool Program::analyze(const CostModel &cm, size_t gen_cnt, bool strict, TimingReport &rep, std::vector<std::string> &err)
+	{
+		rep = TimingReport();
+		if (!prgValid)
+			return false;
+
+		for (size_t i = 0; i < prg_code.size(); ++i)
+		{
+			if (prg_code[i].opc == OPCode::AOGEN && prg_code[i].arg.u >= gen_cnt)
+				add_warning(rep, i, "AOGEN uses generator #" + std::to_string(prg_code[i].arg.u) + ", but only " + std::to_string(gen_cnt) + " are defined");
+			if (prg_code[i].opc == OPCode::AODUAL)
+				for (size_t out = 1; out <= 2; ++out)
+					if (dual_gen(prg_code[i].arg.u, out) >= gen_cnt)
+						add_warning(rep, i, "AODUAL uses generator #" + std::to_string(dual_gen(prg_code[i].arg.u, out)) + ", but only " + std::to_string(gen_cnt) + " are defined");
+		}
 
-		scopes.pop(); // main
+		TimingState st;
+		analyze_range(0, prg_code.size(), cm, st, rep);
+		reset(); // iterations were used by the simulation
 
-		line = -1;
-		for (size_t i = 0; i < scopes.size(); ++i)
-			PARSE_ERR("Scope has not been terminated (missing END)!");
+		rep.run_time_us = st.sched + st.lag + st.pending;
+		rep.records = st.records;
+
+		if (strict && rep.overruns)
+		{
+			prgValid = false;
+			err.push_back("Timing: "s + std::to_string(rep.overruns) + " sync points would be late, worst by ~" + std::to_string(std::lround(rep.max_lag_us)) + " us at instr #" + std::to_string(rep.worst_instr));
+		}
 
 		return prgValid;
 	}
@@ -1,6 +1,7 @@
 #include "webserver.h"
 
 #include <algorithm>
+#include <bit>
 #include <cctype>
 #include <string>
 #include <map>
@@ -13,6 +14,7 @@ using namespace std::literals;
 #include <esp_event.h>
 
 #include "to_integer.h"
+#include "to_floating_point.h"
 
 // #include "rigtorp/SPSCQueue.h"
 // using namespace rigtorp;
@@ -26,6 +28,7 @@ using namespace Interpreter;
 #include "json_helper.h"
 
 #include "SocketReader.h"
+#include "SettingsSax.h"
 
 //
 
@@ -150,8 +153,17 @@ static esp_err_t welcome_handler(httpd_req_t *req)
 					 "ESP-IDF version: ${data.cmpl.idfv}.\n"
 					 "Go to ${data.url.sett} with POST JSON to write settings.\n"
 					 "Go to ${data.url.meas} to GET measured stuff.\n"
+					 "Add ?raw to get packed 12-bit ADC codes behind a header of scales, instead of converted values.\n"
+					 "Go to ${data.url.bench} to GET CPU cycles taken by each instruction.\n"
+					 "Go to ${data.url.stats} to GET sync timing statistics of the last run.\n"
+					 "Go to ${data.url.scan}?mask=&hz=&os=&fmt=(f|m|u|raw)&rng=&n= to GET free-running frames of inputs, closing the stream stops it.\n"
+					 "Add &trig=(in1..in4|di1..di4)&edge=(r|f|b)&lvl=&hyst=&pre=&post= to get only windows of pre + post frames around triggers, n of them.\n"
+					 "Go to ${data.url.logic}?mask=&hz=&us=&n= to GET transitions of digital inputs as varints of (cycles << 4 | state), hz=0 samples as fast as possible.\n"
+					 "Go to ${data.url.cal} to GET the calibration, POST JSON of the same shape to set it, add ?save to store it on the device.\n"
+					 "GET ${data.url.cal}?capture&in=&rng=(MIN|MED|MAX)&ref= with a known reference on the input, twice with different ones, to calibrate it.\n"
 					 "Settings JSON is an object with two keys:\n"
-					 "\t- \"task\" is a string, made of semicolon-separated statements (commands with arguments)\n"
+					 "\t- \"task\" is a string, made of semicolon-separated statements (commands with arguments),\n"
+					 "\t  or an array of such strings, concatenated - statements may span elements, and only one element is buffered at a time, use it for long tasks\n"
 					 "\t- \"generators\" is an array of amplitudes and waveforms\n"
 					 "List of existing commands with syntax and description: ${data.prg.cmds}.\n"
 					 "Exemplary generator of a sine signal: ${data.prg.gnrtr}.\n"
@@ -165,6 +177,11 @@ static esp_err_t welcome_handler(httpd_req_t *req)
 
 	doc["data"]["url"]["sett"] = "/settings";
 	doc["data"]["url"]["meas"] = "/io";
+	doc["data"]["url"]["bench"] = "/bench";
+	doc["data"]["url"]["stats"] = "/stats";
+	doc["data"]["url"]["scan"] = "/scan";
+	doc["data"]["url"]["logic"] = "/logic";
+	doc["data"]["url"]["cal"] = "/cal";
 
 	// Commands
 	doc["data"]["prg"]["cmds"] = ordered_json::array();
@@ -237,84 +254,141 @@ static esp_err_t welcome_handler(httpd_req_t *req)
 
 //
 
-static esp_err_t settings_handler(httpd_req_t *req)
+// Raw stream header: "IORW", u8 version, u8 time bytes, u8 inputs, u8 ranges, u16 LE code offset, u16 zero,
+// then f32 LE scale per input and range (V or A per code step, inputs outer), then f32 LE offset the same way,
+// phy = (code - code offset) * scale + offset
+constexpr uint8_t raw_version = 2;
+constexpr size_t raw_inputs = 4;
+constexpr size_t raw_ranges = 4;
+constexpr size_t raw_header_len = 12 + 2 * 4 * raw_inputs * raw_ranges;
+constexpr size_t raw_trailer_len = 8; // u32 LE sample count, "IORE"
+
+static void push_le(std::string &out, uint32_t val, size_t n)
 {
-	// Make sure that the producer is *not* running
-	if (Communicator::is_running())
-		return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Device is busy");
+	for (size_t i = 0; i < n; ++i)
+		out.push_back(static_cast<char>(val >> (8 * i)));
+}
 
-	ESP_LOGV(TAG, "Req len: %" PRIu16, req->content_len);
+static std::string raw_header(size_t time_bytes)
+{
+	std::string out = "IORW";
+	out.push_back(raw_version);
+	out.push_back(time_bytes);
+	out.push_back(raw_inputs);
+	out.push_back(raw_ranges);
+	push_le(out, Board::raw_code_offset(), 2);
+	push_le(out, 0, 2);
+	for (size_t in = 1; in <= raw_inputs; ++in)
+		for (size_t rng = 0; rng < raw_ranges; ++rng)
+			push_le(out, std::bit_cast<uint32_t>(Board::raw_scale(static_cast<Input>(in), static_cast<AnIn_Range>(rng))), 4);
+	for (size_t in = 1; in <= raw_inputs; ++in)
+		for (size_t rng = 0; rng < raw_ranges; ++rng)
+			push_le(out, std::bit_cast<uint32_t>(Board::raw_offset(static_cast<Input>(in), static_cast<AnIn_Range>(rng))), 4);
+	return out;
+}
 
-	Interpreter::Program program;
-	std::vector<Generator> generators;
-	std::vector<std::string> errors;
+static void timing_to_json(ordered_json &j, const Interpreter::TimingReport &t)
+{
+	j["run_time_us"] = std::llround(t.run_time_us);
+	j["records"] = t.records;
+	for (size_t tb = 0; tb <= 8; ++tb) // indexed by time bytes of the stream
+		j["bytes"][tb] = t.records * (tb + 4);
+	for (size_t tb = 0; tb <= 8; ++tb) // same, with ?raw
+		j["bytes_raw"][tb] = raw_header_len + (t.records + 1) / 2 * (3 + 2 * tb) + raw_trailer_len;
+	j["overruns"] = t.overruns;
+	if (t.overruns)
+	{
+		j["max_lag_us"] = std::llround(t.max_lag_us);
+		j["worst_instr"] = t.worst_instr;
+	}
+	j["warnings"] = t.warnings;
+}
 
-	ESP_LOGD(TAG, "Reading JSON...");
-	SocketReader reader(req);
-	ordered_json q = ordered_json::parse(reader.begin(), reader.end(), nullptr, false, true);
+static void stats_to_json(ordered_json &j, const Board::RunStats &rs)
+{
+	j["run_time_us"] = rs.run_time_us;
+	j["syncs"] = rs.syncs;
+	j["armed_late"] = rs.armed_late;
+	j["max_lag_us"] = rs.max_lag_us;
+	if (rs.worst_instr != size_t(-1))
+		j["worst_instr"] = rs.worst_instr;
+	j["wake_hist"] = rs.wake_hist;
+	j["spin_hist"] = rs.spin_hist;
+	j["io_hist"] = rs.io_hist;
+	j["overruns"] = ordered_json::object();
+	for (size_t i = 0; i < rs.overruns.size(); ++i)
+		if (rs.overruns[i])
+			j["overruns"][CS_LUT[i].namestr] = rs.overruns[i];
+	j["scan_overruns"] = rs.scan_overruns;
+}
 
-	if (reader.err) // failed to read from socket
+// Calibration: {"in": [per input [per range OFF..MAX {"gain", "offset"}]], "out": [per output {"gain", "offset"}]}
+static void calibration_to_json(ordered_json &j, const Board::Calibration &cal)
+{
+	auto point = [](const Board::CalPoint &p)
+	{ return ordered_json{{"gain", p.gain}, {"offset", p.offset}}; };
+
+	j["in"] = ordered_json::array();
+	for (const auto &rngs : cal.in)
 	{
-		ESP_LOGW(TAG, "Reader error");
-		if (reader.err == HTTPD_SOCK_ERR_TIMEOUT)
-			httpd_resp_send_408(req);
-		return reader.err;
+		ordered_json &jin = j["in"].emplace_back(ordered_json::array());
+		for (const auto &p : rngs)
+			jin.push_back(point(p));
 	}
+	j["out"] = ordered_json::array();
+	for (const auto &p : cal.out)
+		j["out"].push_back(point(p));
+}
 
-	if (!q.is_discarded()) // if JSON is valid
+static bool calibration_from_json(const json &j, Board::Calibration &cal)
+{
+	auto point = [](const json &jp, Board::CalPoint &p)
 	{
-		if (q.contains("generators"))
-		{
-			ESP_LOGD(TAG, "Generators exists, trying...");
-			if (q.at("generators").is_array())
-			{
-				size_t count = q.at("generators").size();
-				generators.reserve(count);
-
-				for (auto &[key, val] : q.at("generators").items())
-				{
-					try
-					{
-						Generator g = val.get<Generator>();
-						generators.push_back(std::move(g));
-					}
-					catch (ordered_json::exception &e)
-					{
-						generators.emplace_back();
-						errors.push_back("Generator #"s + key + " failed to parse: " + e.what());
-						ESP_LOGW(TAG, "Generator failed to parse: %s", e.what());
-					}
-					val = nullptr;
-				}
-			}
-			else
-				errors.push_back("\"generators\" is not an array!");
-			q.erase("generators");
-		}
-		if (q.contains("task"))
-		{
-			ESP_LOGD(TAG, "Task exists, trying...");
-			if (q.at("task").is_string())
-			{
-				const std::string &prg = q.at("task").get_ref<const std::string &>();
-				program.parse(prg, errors);
-				ESP_LOGD(TAG, "Task has %u statements", program.size());
-			}
-			else
-				errors.push_back("\"task\" is not a string!");
-			q.erase("task");
-		}
+		if (!jp.is_object())
+			return false;
+		auto g = jp.find("gain");
+		auto o = jp.find("offset");
+		if (g == jp.end() || o == jp.end() || !g->is_number() || !o->is_number())
+			return false;
+		p.gain = g->get<float>();
+		p.offset = o->get<float>();
+		return true;
+	};
+
+	if (!j.is_object() || !j.contains("in") || !j.contains("out"))
+		return false;
+
+	const json &jin = j["in"];
+	const json &jout = j["out"];
+	if (!jin.is_array() || jin.size() != cal.in.size() || !jout.is_array() || jout.size() != cal.out.size())
+		return false;
+
+	for (size_t in = 0; in < cal.in.size(); ++in)
+	{
+		if (!jin[in].is_array() || jin[in].size() != cal.in[in].size())
+			return false;
+		for (size_t rng = 0; rng < cal.in[in].size(); ++rng)
+			if (!point(jin[in][rng], cal.in[in][rng]))
+				return false;
 	}
-	else
-		errors.push_back("JSON is invalid!");
+	for (size_t out = 0; out < cal.out.size(); ++out)
+		if (!point(jout[out], cal.out[out]))
+			return false;
 
-	q.clear();
+	return true; // values are checked by the Board
+}
 
-	ESP_LOGD(TAG, "Moving configs...");
-	if (Board::move_config(program, generators) != ESP_OK)
-		return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Device is busy");
+static void program_to_json(ordered_json &j, size_t instr_parsed, const Interpreter::Program &p)
+{
+	j["instructions"]["parsed"] = instr_parsed;
+	j["instructions"]["optimized"] = p.size();
+	j["memory"]["bytes"] = p.bytes();
+	j["memory"]["loops"] = p.loop_count();
+	j["memory"]["loop_overhead"] = p.loop_count() * Interpreter::loop_overhead;
+}
 
-	//
+static esp_err_t settings_respond(httpd_req_t *req, std::vector<std::string> &errors, ordered_json &&data)
+{
 	ESP_LOGD(TAG, "Responding...");
 
 	httpd_resp_set_type(req, "application/json");
@@ -322,6 +396,7 @@ static esp_err_t settings_handler(httpd_req_t *req)
 	if (!errors.empty())
 	{
 		ordered_json res = create_err_response(errors);
+		res["data"] = std::move(data);
 		errors.clear();
 		std::string out = res.dump();
 		res.clear();
@@ -330,7 +405,8 @@ static esp_err_t settings_handler(httpd_req_t *req)
 	}
 
 	ordered_json res = create_ok_response();
-	res["message"] = "Settings have been validated. No errors found.";
+	res["message"] = "Settings have been validated. No errors found. Program size: ${data.instructions}, memory: ${data.memory}. Timing: ${data.timing}.";
+	res["data"] = std::move(data);
 
 	std::string out = res.dump();
 	res.clear();
@@ -339,32 +415,110 @@ static esp_err_t settings_handler(httpd_req_t *req)
 	return httpd_resp_send(req, out.c_str(), out.length());
 }
 
-//
+// Binary program upload, see Interpreter.h for the format
+static esp_err_t settings_bin_handler(httpd_req_t *req, bool strict)
+{
+	Interpreter::Program program;
+	std::vector<std::string> errors;
+	Interpreter::TimingReport timing;
+	esp_err_t err = ESP_OK;
 
-static esp_err_t io_handler(httpd_req_t *req)
+	size_t remaining = req->content_len;
+	Interpreter::ReadCb read = [&](char *buf, size_t len) -> int
+	{
+		if (remaining == 0)
+			return 0;
+		int ret = httpd_req_recv(req, buf, std::min(len, remaining));
+		if (ret <= 0)
+		{
+			err = ret ? ret : HTTPD_SOCK_ERR_FAIL;
+			return -1;
+		}
+		remaining -= ret;
+		return ret;
+	};
+
+	ESP_LOGD(TAG, "Loading binary program...");
+	program.load(read, req->content_len, errors);
+
+	if (err) // failed to read from socket
+	{
+		ESP_LOGW(TAG, "Reader error");
+		if (err == HTTPD_SOCK_ERR_TIMEOUT)
+			httpd_resp_send_408(req);
+		return err;
+	}
+
+	size_t instr_loaded = program.size();
+	program.optimize();
+	ESP_LOGD(TAG, "Task has %u instructions, %u after optimization", instr_loaded, program.size());
+	program.analyze(Board::get_cost_model(), Board::generator_count(), strict, timing, errors);
+
+	ordered_json data;
+	program_to_json(data, instr_loaded, program);
+	timing_to_json(data["timing"], timing);
+
+	ESP_LOGD(TAG, "Moving program...");
+	if (Board::move_program(program) != ESP_OK)
+		return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Device is busy");
+
+	return settings_respond(req, errors, std::move(data));
+}
+
+static esp_err_t settings_handler(httpd_req_t *req)
 {
 	// Make sure that the producer is *not* running
 	if (Communicator::is_running())
 		return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Device is busy");
 
-	auto qr = parse_query(req);
+	ESP_LOGV(TAG, "Req len: %" PRIu16, req->content_len);
 
-	size_t time_bytes = 0;
-	if (auto it = qr.find("tb"); it != qr.end())
-		try_parse_integer(it->second, time_bytes);
+	char content_type[32] = {};
+	httpd_req_get_hdr_value_str(req, "Content-Type", content_type, sizeof(content_type));
+	if (std::string_view(content_type) == "application/octet-stream")
+	{
+		auto qr = parse_query(req);
+		return settings_bin_handler(req, qr.count("strict"));
+	}
 
-	if (time_bytes > 8)
-		time_bytes = 8;
+	Interpreter::Program program;
+	std::vector<Generator> generators;
+	std::vector<std::string> errors;
+	Interpreter::TimingReport timing;
 
-	// Apply changes
-	ESP_LOGI(TAG, "Preparing Communicator...");
-	Communicator::time_settings(time_bytes);
-	Communicator::cleanup();
+	ESP_LOGD(TAG, "Reading JSON...");
+	SocketReader reader(req);
+	SettingsSax sax(program, generators, errors);
+	json::sax_parse(reader.begin(), reader.end(), &sax, json::input_format_t::json, true, true);
 
-	// Start consumer
-	ESP_LOGI(TAG, "Running consumer...");
-	httpd_resp_set_type(req, "application/octet-stream");
+	if (reader.err) // failed to read from socket
+	{
+		ESP_LOGW(TAG, "Reader error");
+		if (reader.err == HTTPD_SOCK_ERR_TIMEOUT)
+			httpd_resp_send_408(req);
+		return reader.err;
+	}
+
+	program.optimize();
+	ESP_LOGD(TAG, "Task has %u instructions, %u after optimization", sax.instr_parsed, program.size());
+	program.analyze(Board::get_cost_model(), generators.size(), sax.strict, timing, errors);
+
+	ordered_json data;
+	program_to_json(data, sax.instr_parsed, program);
+	timing_to_json(data["timing"], timing);
+
+	ESP_LOGD(TAG, "Moving configs...");
+	if (Board::move_config(program, generators) != ESP_OK)
+		return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Device is busy");
+
+	return settings_respond(req, errors, std::move(data));
+}
+
+//
 
+// Runs the producer and sends what it writes until it is done or the client is gone
+static esp_err_t stream_run(httpd_req_t *req)
+{
 	size_t total_sent = 0;
 	esp_err_t ret = ESP_OK;
 
@@ -406,14 +560,485 @@ static esp_err_t io_handler(httpd_req_t *req)
 		vTaskDelay(pdMS_TO_TICKS(10));
 
 	ESP_LOGW(TAG, "Total sent: %zu bytes...", total_sent);
+	return ret;
+}
+
+// Footer after the records: stats JSON, its u32 LE length, "IOST"
+static esp_err_t stream_stats(httpd_req_t *req)
+{
+	Board::RunStats rs;
+	if (Board::get_run_stats(rs) != ESP_OK)
+		return ESP_OK;
+
+	ordered_json doc;
+	stats_to_json(doc, rs);
+	std::string out = doc.dump();
+	push_le(out, out.length(), 4);
+	out += "IOST";
+
+	return httpd_resp_send_chunk(req, out.data(), out.length());
+}
+
+static esp_err_t io_handler(httpd_req_t *req)
+{
+	// Make sure that the producer is *not* running
+	if (Communicator::is_running())
+		return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Device is busy");
+
+	auto qr = parse_query(req);
+
+	size_t time_bytes = 0;
+	if (auto it = qr.find("tb"); it != qr.end())
+		try_parse_integer(it->second, time_bytes);
+
+	if (time_bytes > 8)
+		time_bytes = 8;
+
+	bool stats = qr.contains("stats");
+	bool raw = qr.contains("raw");
+
+	// Apply changes
+	ESP_LOGI(TAG, "Preparing Communicator...");
+	Communicator::time_settings(time_bytes);
+	Communicator::raw_settings(raw);
+	Communicator::cleanup();
+
+	// Start consumer
+	ESP_LOGI(TAG, "Running consumer...");
+	httpd_resp_set_type(req, "application/octet-stream");
+
+	esp_err_t ret = ESP_OK;
+
+	// Raw records are 12-bit codes in pairs of 3 bytes + 2x time bytes, the header tells how to scale them
+	if (raw)
+	{
+		std::string hdr = raw_header(time_bytes);
+		ret = httpd_resp_send_chunk(req, hdr.data(), hdr.length());
+		if (ret != ESP_OK)
+			return ret;
+	}
 
+	ret = stream_run(req);
 	if (ret != ESP_OK)
 		return ret;
 
+	// Trailer after raw records, the count tells whether the last pair is padded
+	if (raw)
+	{
+		std::string out;
+		push_le(out, Communicator::code_count(), 4);
+		out += "IORE";
+
+		ret = httpd_resp_send_chunk(req, out.data(), out.length());
+		if (ret != ESP_OK)
+			return ret;
+	}
+
+	if (stats)
+	{
+		ret = stream_stats(req);
+		if (ret != ESP_OK)
+			return ret;
+	}
+
 	ESP_LOGI(TAG, "Handler done.");
 	return httpd_resp_send_chunk(req, nullptr, 0);
 }
 
+static esp_err_t scan_handler(httpd_req_t *req)
+{
+	// Make sure that the producer is *not* running
+	if (Communicator::is_running())
+		return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Device is busy");
+
+	auto qr = parse_query(req);
+	Board::ScanConfig cfg;
+
+	size_t time_bytes = 0;
+	if (auto it = qr.find("tb"); it != qr.end())
+		try_parse_integer(it->second, time_bytes);
+
+	if (time_bytes > 8)
+		time_bytes = 8;
+
+	bool ok = true;
+	if (auto it = qr.find("mask"); it != qr.end())
+		ok = ok && try_parse_integer(it->second, cfg.mask, 0);
+	if (auto it = qr.find("hz"); it != qr.end())
+	{
+		uint32_t hz = 0;
+		ok = ok && try_parse_integer(it->second, hz) && hz > 0 && hz <= 1'000'000;
+		cfg.period_us = ok ? 1'000'000 / hz : 0;
+	}
+	if (auto it = qr.find("os"); it != qr.end())
+		ok = ok && try_parse_integer(it->second, cfg.oversample);
+	if (auto it = qr.find("n"); it != qr.end())
+		ok = ok && try_parse_integer(it->second, cfg.frames);
+	if (auto it = qr.find("fmt"); it != qr.end())
+	{
+		static const std::map<std::string, Board::ScanFormat, std::less<>> formats = {
+			{"f", Board::ScanFormat::Float},
+			{"m", Board::ScanFormat::Milli},
+			{"u", Board::ScanFormat::Micro},
+			{"raw", Board::ScanFormat::Raw},
+		};
+		auto fit = formats.find(it->second);
+		ok = ok && fit != formats.end();
+		if (ok)
+			cfg.format = fit->second;
+	}
+	if (auto it = qr.find("trig"); it != qr.end()) // in1..in4 or di1..di4
+	{
+		Board::ScanTrigger &tr = cfg.trigger;
+		std::string_view src = it->second;
+		if (src.starts_with("in"))
+			tr.source = Board::TriggerSource::Analog;
+		else if (src.starts_with("di"))
+			tr.source = Board::TriggerSource::Digital;
+		else
+			ok = false;
+		ok = ok && try_parse_integer(it->second.substr(2), tr.port);
+
+		if (auto eit = qr.find("edge"); eit != qr.end())
+		{
+			static const std::map<std::string, Board::TriggerEdge, std::less<>> edges = {
+				{"r", Board::TriggerEdge::Rising},
+				{"f", Board::TriggerEdge::Falling},
+				{"b", Board::TriggerEdge::Both},
+			};
+			auto fit = edges.find(eit->second);
+			ok = ok && fit != edges.end();
+			if (ok)
+				tr.edge = fit->second;
+		}
+		if (auto lit = qr.find("lvl"); lit != qr.end())
+			ok = ok && try_parse_floating_point(lit->second, tr.level);
+		if (auto hit = qr.find("hyst"); hit != qr.end())
+			ok = ok && try_parse_floating_point(hit->second, tr.hysteresis);
+		if (auto pit = qr.find("pre"); pit != qr.end())
+			ok = ok && try_parse_integer(pit->second, tr.pre);
+		if (auto pit = qr.find("post"); pit != qr.end())
+			ok = ok && try_parse_integer(pit->second, tr.post);
+		if (auto nit = qr.find("n"); nit != qr.end()) // windows instead of frames
+			ok = ok && try_parse_integer(nit->second, tr.captures);
+	}
+	if (auto it = qr.find("rng"); it != qr.end()) // comma-separated, for inputs 1.. in order
+	{
+		static constexpr std::string_view names[] = {"OFF", "MIN", "MED", "MAX"};
+		std::string_view list = it->second;
+		for (size_t i = 0; ok && i < cfg.ranges.size() && !list.empty(); ++i)
+		{
+			std::string_view name = list.substr(0, list.find(','));
+			list.remove_prefix(std::min(list.length(), name.length() + 1));
+			auto nit = std::find(std::begin(names), std::end(names), name);
+			ok = nit != std::end(names);
+			if (ok)
+				cfg.ranges[i] = static_cast<AnIn_Range>(nit - std::begin(names));
+		}
+	}
+
+	if (!ok || cfg.mask == 0 || cfg.mask > 0b1111 || cfg.oversample == 0 || cfg.period_us == 0)
+		return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid scan settings");
+
+	// Armed before anything is sent, the Board validates the trigger and allocates its ring
+	esp_err_t ret = Board::arm_scan(cfg);
+	if (ret == ESP_ERR_INVALID_ARG)
+		return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid trigger settings");
+	if (ret == ESP_ERR_NO_MEM)
+		return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Not enough memory for the trigger window");
+	if (ret != ESP_OK)
+		return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Device is busy");
+
+	// Apply changes
+	ESP_LOGI(TAG, "Preparing Communicator...");
+	Communicator::time_settings(time_bytes);
+	Communicator::raw_settings(false);
+	Communicator::cleanup();
+
+	// Frames are fixed size, a raw one is scaled with the same header as raw records
+	ESP_LOGI(TAG, "Running consumer...");
+	httpd_resp_set_type(req, "application/octet-stream");
+
+	if (cfg.format == Board::ScanFormat::Raw)
+	{
+		std::string hdr = raw_header(time_bytes);
+		ret = httpd_resp_send_chunk(req, hdr.data(), hdr.length());
+		if (ret != ESP_OK)
+		{
+			Board::disarm_scan();
+			return ret;
+		}
+	}
+
+	ESP_LOGI(TAG, "Scanning mask 0x%" PRIx8 " every %" PRIu32 "us, frames of %zu bytes...", cfg.mask, cfg.period_us, Board::scan_frame_bytes(cfg) + time_bytes);
+	if (cfg.trigger.source != Board::TriggerSource::None)
+		ESP_LOGI(TAG, "Triggered on port %" PRIu8 ", windows of %" PRIu32 " + %" PRIu32 " frames...", cfg.trigger.port, cfg.trigger.pre, cfg.trigger.post);
+
+	ret = stream_run(req);
+	if (ret != ESP_OK)
+		return ret;
+
+	if (qr.contains("stats"))
+	{
+		ret = stream_stats(req);
+		if (ret != ESP_OK)
+			return ret;
+	}
+
+	ESP_LOGI(TAG, "Handler done.");
+	return httpd_resp_send_chunk(req, nullptr, 0);
+}
+
+
+//
+
+// Logic stream: header "IOLA", u8 version, u8 mask, u16 LE CPU cycles per us, then varint records (see Board.h),
+// trailer u32 LE record count, u32 LE flags (bit 0: stopped on overflow), "IOLE"
+constexpr uint8_t logic_version = 1;
+
+static esp_err_t logic_handler(httpd_req_t *req)
+{
+	// Make sure that the producer is *not* running
+	if (Communicator::is_running())
+		return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Device is busy");
+
+	auto qr = parse_query(req);
+	Board::LogicConfig cfg;
+
+	bool ok = true;
+	if (auto it = qr.find("mask"); it != qr.end())
+		ok = ok && try_parse_integer(it->second, cfg.mask, 0);
+	if (auto it = qr.find("hz"); it != qr.end()) // 0: as fast as possible
+	{
+		uint32_t hz = 0;
+		ok = ok && try_parse_integer(it->second, hz) && hz <= Board::cycles_per_us() * 1'000'000;
+		cfg.period_cycles = (ok && hz) ? Board::cycles_per_us() * 1'000'000 / hz : 0;
+	}
+	if (auto it = qr.find("us"); it != qr.end())
+		ok = ok && try_parse_integer(it->second, cfg.duration_us);
+	if (auto it = qr.find("n"); it != qr.end())
+		ok = ok && try_parse_integer(it->second, cfg.transitions);
+
+	if (!ok)
+		return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid logic settings");
+
+	esp_err_t ret = Board::arm_logic(cfg);
+	if (ret == ESP_ERR_INVALID_ARG)
+		return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid logic settings");
+	if (ret != ESP_OK)
+		return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Device is busy");
+
+	// Apply changes
+	ESP_LOGI(TAG, "Preparing Communicator...");
+	Communicator::time_settings(0);
+	Communicator::raw_settings(false);
+	Communicator::cleanup();
+
+	ESP_LOGI(TAG, "Running consumer...");
+	httpd_resp_set_type(req, "application/octet-stream");
+
+	std::string hdr = "IOLA";
+	hdr.push_back(logic_version);
+	hdr.push_back(cfg.mask);
+	push_le(hdr, Board::cycles_per_us(), 2);
+
+	ret = httpd_resp_send_chunk(req, hdr.data(), hdr.length());
+	if (ret != ESP_OK)
+	{
+		Board::disarm_scan(); // drops the logic capture too
+		return ret;
+	}
+
+	ESP_LOGI(TAG, "Capturing transitions of mask 0x%" PRIx8 "...", cfg.mask);
+	ret = stream_run(req);
+	if (ret != ESP_OK)
+		return ret;
+
+	Board::LogicResult res;
+	Board::get_logic_result(res);
+	ESP_LOGI(TAG, "Records: %" PRIu32 ", cycles: %" PRIu64, res.records, res.cycles);
+
+	std::string out;
+	push_le(out, res.records, 4);
+	push_le(out, res.overflow, 4);
+	out += "IOLE";
+
+	ret = httpd_resp_send_chunk(req, out.data(), out.length());
+	if (ret != ESP_OK)
+		return ret;
+
+	ESP_LOGI(TAG, "Handler done.");
+	return httpd_resp_send_chunk(req, nullptr, 0);
+}
+
+//
+
+static esp_err_t cal_capture(httpd_req_t *req, const std::map<std::string, std::string> &qr, ordered_json &data)
+{
+	static constexpr std::string_view names[] = {"OFF", "MIN", "MED", "MAX"};
+
+	uint8_t in = 0;
+	float ref = 0;
+	auto it_in = qr.find("in");
+	auto it_rng = qr.find("rng");
+	auto it_ref = qr.find("ref");
+	if (it_in == qr.end() || it_rng == qr.end() || it_ref == qr.end())
+		return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Capture needs in, rng and ref");
+
+	auto nit = std::find(std::begin(names), std::end(names), it_rng->second);
+	if (!try_parse_integer(it_in->second, in) || nit == std::end(names) || !try_parse_floating_point(it_ref->second, ref))
+		return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid capture settings");
+
+	float nominal = 0;
+	bool done = false;
+	esp_err_t err = Board::calibrate_capture(static_cast<Input>(in), static_cast<AnIn_Range>(nit - std::begin(names)), ref, nominal, done);
+	if (err == ESP_ERR_INVALID_ARG || err == ESP_ERR_INVALID_RESPONSE)
+		return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid capture, use a valid input and range, and references apart");
+	if (err != ESP_OK)
+		return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Device is busy");
+
+	data["nominal"] = nominal;
+	data["done"] = done;
+	return ESP_OK;
+}
+
+static esp_err_t cal_handler(httpd_req_t *req)
+{
+	// Make sure that the producer is *not* running
+	if (Communicator::is_running())
+		return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Device is busy");
+
+	auto qr = parse_query(req);
+	ordered_json data;
+	esp_err_t err = ESP_OK;
+
+	if (req->method == HTTP_POST)
+	{
+		constexpr size_t max_len = 2048;
+		if (req->content_len > max_len)
+			return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Calibration JSON is too long");
+
+		std::string body(req->content_len, '\0');
+		for (size_t got = 0; got < body.length();)
+		{
+			int ret = httpd_req_recv(req, body.data() + got, body.length() - got);
+			if (ret <= 0)
+			{
+				ESP_LOGW(TAG, "Reader error");
+				if (ret == HTTPD_SOCK_ERR_TIMEOUT)
+					httpd_resp_send_408(req);
+				return ret ? ret : HTTPD_SOCK_ERR_FAIL;
+			}
+			got += ret;
+		}
+
+		Board::Calibration cal;
+		json j = json::parse(body, nullptr, false);
+		if (j.is_discarded() || !calibration_from_json(j, cal))
+			return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid calibration JSON");
+
+		err = Board::set_calibration(cal);
+		if (err == ESP_ERR_INVALID_ARG)
+			return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Gains must be positive, values finite");
+	}
+	else if (qr.contains("capture"))
+	{
+		err = cal_capture(req, qr, data);
+		if (!data.contains("done")) // response sent
+			return err;
+	}
+
+	if (err == ESP_OK && qr.contains("save"))
+		err = Board::save_calibration();
+
+	Board::Calibration cal;
+	if (err == ESP_OK)
+		err = Board::get_calibration(cal);
+
+	if (err != ESP_OK)
+		return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Device is busy or storage failed");
+
+	httpd_resp_set_status(req, HTTPD_200);
+	httpd_resp_set_type(req, "application/json");
+
+	ordered_json doc = create_ok_response();
+	doc["message"] = "Calibration, actual = gain * nominal + offset: ${data.calibration}.";
+	calibration_to_json(data["calibration"], cal);
+	doc["data"] = std::move(data);
+
+	std::string out = doc.dump();
+
+	ESP_LOGI(TAG, "Handler done.");
+	return httpd_resp_send(req, out.c_str(), out.length());
+}
+
+//
+
+static esp_err_t bench_handler(httpd_req_t *req)
+{
+	// Make sure that the producer is *not* running
+	if (Communicator::is_running())
+		return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Device is busy");
+
+	auto qr = parse_query(req);
+
+	size_t reps = 100;
+	if (auto it = qr.find("reps"); it != qr.end())
+		try_parse_integer(it->second, reps);
+
+	std::vector<std::pair<OPCode, uint32_t>> cycles;
+	std::vector<std::pair<const char *, uint32_t>> forms;
+
+	ESP_LOGI(TAG, "Benchmarking instructions...");
+	if (Board::benchmark(cycles, forms, reps) != ESP_OK)
+		return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Benchmark failed");
+
+	httpd_resp_set_status(req, HTTPD_200);
+	httpd_resp_set_type(req, "application/json");
+
+	ordered_json doc = create_ok_response();
+	doc["message"] = "Average CPU cycles per instruction handler (incl. hardware access): ${data.cycles}, and of specific instruction forms: ${data.forms}.";
+	doc["data"]["reps"] = reps;
+	doc["data"]["cycles"] = ordered_json::object();
+
+	for (const auto &[opc, cyc] : cycles)
+		doc["data"]["cycles"][CS_LUT[static_cast<size_t>(opc)].namestr] = cyc;
+
+	doc["data"]["forms"] = ordered_json::object();
+	for (const auto &[form, cyc] : forms)
+		doc["data"]["forms"][form] = cyc;
+
+	std::string out = doc.dump();
+
+	ESP_LOGI(TAG, "Handler done.");
+	return httpd_resp_send(req, out.c_str(), out.length());
+}
+
+//
+
+static esp_err_t stats_handler(httpd_req_t *req)
+{
+	Board::RunStats rs;
+	esp_err_t err = Board::get_run_stats(rs);
+	if (err == ESP_ERR_NOT_SUPPORTED)
+		return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Statistics are disabled");
+	if (err != ESP_OK)
+		return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Device is busy");
+
+	httpd_resp_set_status(req, HTTPD_200);
+	httpd_resp_set_type(req, "application/json");
+
+	ordered_json doc = create_ok_response();
+	doc["message"] = "Sync points of the last run: ${data.syncs}, reached late: ${data.overruns}, worst lag: ${data.max_lag_us}us. "
+					 "Histograms count latencies in log2 buckets of us: [0], [1], [2,3], [4,7], ...";
+	stats_to_json(doc["data"], rs);
+
+	std::string out = doc.dump();
+
+	ESP_LOGI(TAG, "Handler done.");
+	return httpd_resp_send(req, out.c_str(), out.length());
+}
+
 //
 
 static constexpr httpd_uri_t favicon_uri = {
@@ -444,6 +1069,48 @@ static constexpr httpd_uri_t settings_uri = {
 	.user_ctx = nullptr,
 };
 
+static constexpr httpd_uri_t bench_uri = {
+	.uri = "/bench",
+	.method = HTTP_GET,
+	.handler = bench_handler,
+	.user_ctx = nullptr,
+};
+
+static constexpr httpd_uri_t scan_uri = {
+	.uri = "/scan",
+	.method = HTTP_GET,
+	.handler = scan_handler,
+	.user_ctx = nullptr,
+};
+
+static constexpr httpd_uri_t stats_uri = {
+	.uri = "/stats",
+	.method = HTTP_GET,
+	.handler = stats_handler,
+	.user_ctx = nullptr,
+};
+
+static constexpr httpd_uri_t logic_uri = {
+	.uri = "/logic",
+	.method = HTTP_GET,
+	.handler = logic_handler,
+	.user_ctx = nullptr,
+};
+
+static constexpr httpd_uri_t cal_get_uri = {
+	.uri = "/cal",
+	.method = HTTP_GET,
+	.handler = cal_handler,
+	.user_ctx = nullptr,
+};
+
+static constexpr httpd_uri_t cal_post_uri = {
+	.uri = "/cal",
+	.method = HTTP_POST,
+	.handler = cal_handler,
+	.user_ctx = nullptr,
+};
+
 //
 
 static httpd_handle_t server = nullptr;
@@ -456,7 +1123,7 @@ esp_err_t start_webserver()
 	config.stack_size = HTTP_MEM;
 	config.core_id = CPU0;
 	config.max_open_sockets = 1; // 3 for internal, 1 for external
-	config.max_uri_handlers = 4;
+	config.max_uri_handlers = 10;
 
 	config.lru_purge_enable = true;
 
@@ -490,6 +1157,30 @@ esp_err_t start_webserver()
 		httpd_register_uri_handler(server, &favicon_uri),
 		TAG, "Failed to httpd_register_uri_handler!");
 
+	ESP_RETURN_ON_ERROR(
+		httpd_register_uri_handler(server, &bench_uri),
+		TAG, "Failed to httpd_register_uri_handler!");
+
+	ESP_RETURN_ON_ERROR(
+		httpd_register_uri_handler(server, &stats_uri),
+		TAG, "Failed to httpd_register_uri_handler!");
+
+	ESP_RETURN_ON_ERROR(
+		httpd_register_uri_handler(server, &scan_uri),
+		TAG, "Failed to httpd_register_uri_handler!");
+
+	ESP_RETURN_ON_ERROR(
+		httpd_register_uri_handler(server, &logic_uri),
+		TAG, "Failed to httpd_register_uri_handler!");
+
+	ESP_RETURN_ON_ERROR(
+		httpd_register_uri_handler(server, &cal_get_uri),
+		TAG, "Failed to httpd_register_uri_handler!");
+
+	ESP_RETURN_ON_ERROR(
+		httpd_register_uri_handler(server, &cal_post_uri),
+		TAG, "Failed to httpd_register_uri_handler!");
+
 	return ESP_OK;
 }
 
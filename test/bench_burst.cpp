@@ -0,0 +1,198 @@
+// MCP3xxx::burst over a mock SPI driver: the CPU cost per sample of queueing, collecting and parsing,
+// for AIRDB bursts of one and of all four ports, interleaved like Board's analog_inputs_burst(),
+// next to the same samples read through the polling pipeline(), one port after another like AIRDF per port.
+// The mock completes transactions instantly, so this is the ceiling the bookkeeping puts on the sample rate;
+// on the device the 2 MHz bus (~10us per conversion) is the limit while this stays well below it.
+// Polling looks cheaper here for the same reason: on the device polling_end() spins for the whole conversion,
+// the bus time is spent on the CPU, while a burst leaves it to the queue.
+
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+
+#include "MCP3XXX.h"
+
+struct spi_device_t
+{
+	std::deque<spi_transaction_t *> in_flight;
+	size_t max_in_flight = 0;
+	spi_transaction_t *polling = nullptr;
+	size_t overlaps = 0; // polling started with another transaction on the bus
+};
+
+namespace
+{
+	spi_device_t device;
+
+	constexpr uint16_t code_of(uint64_t chnl)
+	{
+		return 0x123 + 0x300 * chnl;
+	}
+
+	// the bits as they arrive on the wire, MSB first, left aligned
+	void complete(spi_transaction_t *trx)
+	{
+		uint32_t wire = __builtin_bswap32(uint32_t(code_of(trx->addr)) << (32 - trx->rxlength));
+		std::memcpy(trx->rx_data, &wire, sizeof(wire));
+	}
+}
+
+esp_err_t spi_bus_add_device(spi_host_device_t, const spi_device_interface_config_t *, spi_device_handle_t *hdl)
+{
+	*hdl = &device;
+	return ESP_OK;
+}
+
+esp_err_t spi_device_queue_trans(spi_device_handle_t hdl, spi_transaction_t *trx, TickType_t)
+{
+	hdl->in_flight.push_back(trx);
+	hdl->max_in_flight = std::max(hdl->max_in_flight, hdl->in_flight.size());
+	return ESP_OK;
+}
+
+esp_err_t spi_device_get_trans_result(spi_device_handle_t hdl, spi_transaction_t **trx, TickType_t)
+{
+	if (hdl->in_flight.empty())
+		return ESP_ERR_TIMEOUT;
+
+	*trx = hdl->in_flight.front();
+	hdl->in_flight.pop_front();
+	complete(*trx);
+	return ESP_OK;
+}
+
+esp_err_t spi_device_polling_start(spi_device_handle_t hdl, spi_transaction_t *trx, TickType_t)
+{
+	hdl->overlaps += (hdl->polling || !hdl->in_flight.empty());
+	hdl->polling = trx;
+	return ESP_OK;
+}
+
+esp_err_t spi_device_polling_end(spi_device_handle_t hdl, TickType_t)
+{
+	if (!hdl->polling)
+		return ESP_ERR_INVALID_STATE;
+
+	complete(hdl->polling);
+	hdl->polling = nullptr;
+	return ESP_OK;
+}
+
+namespace
+{
+	constexpr size_t an_in_num = 4;
+	constexpr size_t queue_sz = 8;
+	constexpr uint32_t reps = 64;
+	constexpr size_t bursts = 20000;
+
+	MCP3204 adc(SPI3_HOST, GPIO_NUM_5, 2'000'000, queue_sz);
+	std::array<std::array<spi_transaction_t, 2>, an_in_num> trx_in; // two slots each, for pipelining
+	std::array<spi_transaction_t, queue_sz> trx_burst;
+
+	struct Workload
+	{
+		uint32_t mask;
+		std::array<uint8_t, an_in_num> chnls = {};
+		size_t nch = 0;
+		std::array<int32_t, an_in_num> sums = {};
+		size_t order_errors = 0;
+	};
+
+	// Reads reps samples of every port in the workload, bursts times; ns per sample, < 0 on failure
+	template <typename F>
+	double timed(const char *how, Workload &w, F &&read)
+	{
+		auto start = std::chrono::steady_clock::now();
+		for (size_t b = 0; b < bursts; ++b)
+		{
+			w.sums.fill(0);
+			esp_err_t err = read();
+			if (err != ESP_OK)
+			{
+				printf("FAIL %s mask 0x%" PRIx32 ": returned %s\n", how, w.mask, esp_err_to_name(err));
+				return -1;
+			}
+		}
+		std::chrono::duration<double, std::nano> took = std::chrono::steady_clock::now() - start;
+
+		bool ok = (w.order_errors == 0);
+		for (size_t i = 0; i < w.nch; ++i)
+			if (w.sums[w.chnls[i]] != int32_t(reps) * code_of(w.chnls[i]))
+			{
+				printf("FAIL %s mask 0x%" PRIx32 ": port %u sum %" PRIi32 ", expected %" PRIi32 "\n", how, w.mask, w.chnls[i] + 1u, w.sums[w.chnls[i]], int32_t(reps) * code_of(w.chnls[i]));
+				ok = false;
+			}
+
+		return ok ? took.count() / (double(bursts) * reps * w.nch) : -1;
+	}
+
+	bool bench(uint32_t mask)
+	{
+		Workload w{.mask = mask};
+		for (size_t i = 0; i < an_in_num; ++i)
+			if (mask & BIT(i))
+				w.chnls[w.nch++] = i;
+
+		double burst = timed("burst", w, [&]()
+							 {
+								 size_t expect = 0;
+								 return adc.burst(
+									 trx_burst, size_t(reps) * w.nch,
+									 [&](size_t i, spi_transaction_t &trx)
+									 { trx = trx_in[w.chnls[i % w.nch]][0]; },
+									 [&](size_t i, const spi_transaction_t &trx)
+									 {
+										 w.order_errors += (i != expect++);
+										 w.sums[w.chnls[i % w.nch]] += adc.parse_trx(trx);
+									 });
+							 });
+
+		double polling = timed("pipeline", w, [&]()
+							   {
+								   for (size_t i = 0; i < w.nch; ++i)
+								   {
+									   int32_t &sum = w.sums[w.chnls[i]];
+									   esp_err_t err = adc.pipeline(
+										   trx_in[w.chnls[i]], reps,
+										   [&](const spi_transaction_t &trx)
+										   { sum += adc.parse_trx(trx); });
+									   if (err != ESP_OK)
+										   return err;
+								   }
+								   return ESP_OK;
+							   });
+
+		if (burst < 0 || polling < 0)
+			return false;
+
+		printf("AIRDB 0x%" PRIx32 " %" PRIu32 ": burst %.1f ns/sample (%.1f Msps), polling %.1f ns/sample (%.1f Msps), CPU-bound\n",
+			   mask, reps, burst, 1e3 / burst, polling, 1e3 / polling);
+		return true;
+	}
+}
+
+int main()
+{
+	if (adc.init() != ESP_OK)
+		return 1;
+
+	for (size_t i = 0; i < an_in_num; ++i)
+		trx_in[i].fill(MCP3204::make_trx(i));
+
+	bool ok = bench(0b0001) && bench(0b1111);
+
+	if (device.max_in_flight > queue_sz)
+	{
+		printf("FAIL %zu transactions in flight, queue holds %zu\n", device.max_in_flight, queue_sz);
+		ok = false;
+	}
+	if (device.overlaps)
+	{
+		printf("FAIL %zu polling transactions started over another one\n", device.overlaps);
+		ok = false;
+	}
+
+	return ok ? 0 : 1;
+}
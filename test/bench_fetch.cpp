@@ -0,0 +1,222 @@
+// Instruction fetch through Program::getInstr(), the executor's loop minus the handlers:
+// the cost per fetched instruction of walking the flat bytecode, loops included,
+// next to the Scope/Loop tree the bytecode replaced, kept below as it was walked then.
+// The copy fetches at the rate of the original, baseline commit 6151af2 (main/include, main/src/Interpreter.cpp),
+// whose own Program::getInstr() runs this program's text within a few percent of it.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <variant>
+#include <vector>
+
+#include "Interpreter.h"
+
+using namespace Interpreter;
+
+namespace
+{
+	// a straight body, a short inner loop and a nested one, as in sweep-and-read programs
+	constexpr const char *text =
+		"LOOP 20000; AIEN; AIRDF 1 1; AIRDF 2 1; AOVAL 1 0.5; DOSET 1; DELAY 10; "
+		"LOOP 3; AIRDM 3 2; DOXOR 1; END; "
+		"LOOP 2; LOOP 2; GETTM; DELAY 5; END; AOGEN 2 0; END; "
+		"DORST 1; AIDIS; END;";
+	constexpr size_t runs = 20;
+}
+
+// The baseline fetch: a tree of statements, each Loop a heap node with its own Scope
+namespace baseline
+{
+	class Loop;
+	using LoopPtr = std::unique_ptr<Loop>;
+	using Statement = std::variant<std::monostate, Instruction, LoopPtr>;
+
+	class Scope
+	{
+		std::vector<Statement> statements;
+		mutable size_t index = 0;
+
+	public:
+		InstrPtr getInstr() const;
+		bool finished() const { return index >= statements.size(); }
+		void reset() const;
+		void restart() const { index = 0; }
+
+		void appendInstr(const Instruction &c) { statements.emplace_back(std::in_place_type<Instruction>, c); }
+		Loop &appendLoop(size_t iters);
+	};
+
+	class Loop
+	{
+		Scope scope;
+		size_t max_iter = 0;
+		mutable size_t iter = 0;
+
+	public:
+		Loop(size_t mi) : max_iter(mi) {}
+
+		InstrPtr getInstr() const
+		{
+			if (finished()) [[unlikely]] // never
+				return nullinstr;
+
+			InstrPtr ret = scope.getInstr();
+
+			if (scope.finished())
+			{
+				++iter;
+				scope.restart();
+			}
+
+			return ret;
+		}
+		bool finished() const { return iter >= max_iter; }
+
+		void reset() const
+		{
+			iter = 0;
+			scope.reset();
+		}
+		void restart() const { iter = 0; }
+
+		Scope &getScope() { return scope; }
+	};
+
+	InstrPtr Scope::getInstr() const
+	{
+		if (finished()) [[unlikely]] // never
+			return nullinstr;
+
+		const Statement &stmt = statements[index];
+
+		switch (stmt.index()) // check type
+		{
+		case 1: // cmd
+		{
+			++index;
+			return &std::get<Instruction>(stmt);
+		}
+		case 2: // loop
+		{
+			const Loop &loop = *std::get<LoopPtr>(stmt);
+			InstrPtr ret = loop.getInstr();
+			if (loop.finished())
+			{
+				++index;
+				loop.restart();
+			}
+			return ret;
+		}
+		default:
+			return nullinstr;
+		}
+	}
+
+	void Scope::reset() const
+	{
+		index = 0;
+		for (const Statement &stmt : statements)
+			if (stmt.index() == 2)
+				std::get<LoopPtr>(stmt)->reset();
+	}
+
+	Loop &Scope::appendLoop(size_t iters)
+	{
+		statements.emplace_back(std::in_place_type<LoopPtr>, std::make_unique<Loop>(iters));
+		return *std::get<LoopPtr>(statements.back());
+	}
+
+	// The same instructions as the packed program, nested by its LOOP/END records; iteration counts come from the text
+	// (the baseline skipped empty loops: LOOP 0 is not expected here)
+	void build(const Program &prg, const char *src, Scope &main)
+	{
+		std::vector<Scope *> scopes = {&main};
+		const char *loop = src;
+
+		for (const Instruction &instr : prg.instructions())
+		{
+			if (instr.opc == OPCode::LOOP)
+			{
+				loop = std::strstr(loop, "LOOP ") + 5;
+				scopes.push_back(&scopes.back()->appendLoop(std::strtoul(loop, nullptr, 10)).getScope());
+			}
+			else if (instr.opc == OPCode::END)
+				scopes.pop_back();
+			else
+				scopes.back()->appendInstr(instr);
+		}
+	}
+}
+
+namespace
+{
+	// Fetches the whole program runs times, sink reads what a handler would; ns per instruction of the best run
+	template <typename P>
+	double best_fetch(const P &prg, size_t &fetched, uint32_t &sink)
+	{
+		double best = 1e300;
+
+		for (size_t r = 0; r < runs; ++r)
+		{
+			fetched = 0;
+			prg.reset();
+
+			auto start = std::chrono::steady_clock::now();
+			for (InstrPtr instr; (instr = prg.getInstr()) != nullinstr; ++fetched)
+				sink += instr->arg.u;
+			std::chrono::duration<double, std::nano> took = std::chrono::steady_clock::now() - start;
+
+			best = std::min(best, took.count());
+		}
+
+		return best / fetched;
+	}
+
+	// The baseline Program: the main Scope, ended when it is
+	struct BaselineProgram
+	{
+		baseline::Scope scope;
+
+		InstrPtr getInstr() const
+		{
+			if (scope.finished()) [[unlikely]]
+				return nullinstr;
+			return scope.getInstr();
+		}
+		void reset() const { scope.reset(); }
+	};
+}
+
+int main()
+{
+	std::vector<std::string> err;
+	Program prg;
+	if (!prg.parse(text, err))
+	{
+		printf("FAIL parse: %s\n", err.empty() ? "" : err.front().c_str());
+		return 1;
+	}
+
+	BaselineProgram tree;
+	baseline::build(prg, text, tree.scope);
+
+	size_t fetched = 0, fetched_tree = 0;
+	uint32_t sink = 0, sink_tree = 0;
+	double flat = best_fetch(prg, fetched, sink);
+	double nested = best_fetch(tree, fetched_tree, sink_tree);
+
+	if (fetched != fetched_tree || sink != sink_tree)
+	{
+		printf("FAIL the walks differ: %zu fetches (sink %" PRIu32 "), tree %zu (sink %" PRIu32 ")\n", fetched, sink, fetched_tree, sink_tree);
+		return 1;
+	}
+
+	printf("%zu instructions fetched per run (sink %" PRIu32 ")\n", fetched, sink);
+	printf("Program::getInstr: %.2f ns/instruction, baseline Scope/Loop tree: %.2f ns/instruction\n", flat, nested);
+	return 0;
+}
@@ -0,0 +1,80 @@
+// Parse throughput of the text program format, as uploaded: whole through Program::parse,
+// and fed in chunks through Program::Parser like the streamed "task" array of /settings.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "Interpreter.h"
+
+using namespace Interpreter;
+
+namespace
+{
+	constexpr const char *block =
+		"LOOP 100; AIRNG 1 MAX; AIEN; AIRDF 1 16; AIRDM 2 64; AOVAL 1 0.125; "
+		"AOGEN 2 0; DOSET 5; DELAY 250; DORST 0x5; GETTM; END;\n";
+	constexpr size_t blocks = 2000;
+	constexpr size_t runs = 20;
+	constexpr size_t chunk = 256; // bytes, of a "task" array element
+
+	template <typename F>
+	double best_ns(F &&f)
+	{
+		double best = 1e300;
+		for (size_t r = 0; r < runs; ++r)
+		{
+			auto start = std::chrono::steady_clock::now();
+			if (!f())
+				return -1;
+			std::chrono::duration<double, std::nano> took = std::chrono::steady_clock::now() - start;
+			best = std::min(best, took.count());
+		}
+		return best;
+	}
+
+	void report(const char *what, double ns, const std::string &text, size_t statements)
+	{
+		printf("%s: %.2f MB/s, %.0f ns/statement\n", what, text.size() / ns * 1e3, ns / statements);
+	}
+}
+
+int main()
+{
+	std::string text;
+	for (size_t b = 0; b < blocks; ++b)
+		text += block;
+	const size_t statements = std::count(text.begin(), text.end(), ';');
+
+	std::vector<std::string> err;
+
+	double whole = best_ns([&]()
+						   {
+							   Program prg;
+							   err.clear();
+							   return prg.parse(text, err);
+						   });
+
+	double chunked = best_ns([&]()
+							 {
+								 Program prg;
+								 err.clear();
+								 Program::Parser parser(prg, err);
+								 for (size_t pos = 0; pos < text.size(); pos += chunk)
+									 parser.feed(std::string_view(text).substr(pos, chunk));
+								 return parser.finish();
+							 });
+
+	if (whole < 0 || chunked < 0)
+	{
+		printf("FAIL parse: %s\n", err.empty() ? "" : err.front().c_str());
+		return 1;
+	}
+
+	printf("%zu statements, %zu bytes\n", statements, text.size());
+	report("Program::parse", whole, text, statements);
+	report("Program::Parser, 256 byte chunks", chunked, text, statements);
+	return 0;
+}
@@ -0,0 +1,12 @@
+#pragma once
+// Host stub of the ESP-IDF GPIO driver, pin numbers only
+
+#include <freertos/FreeRTOS.h>
+#include <esp_err.h>
+
+typedef enum
+{
+	GPIO_NUM_NC = -1,
+	GPIO_NUM_5 = 5,
+	GPIO_NUM_15 = 15,
+} gpio_num_t;
@@ -0,0 +1,70 @@
+#pragma once
+// Host stub of the ESP-IDF SPI master driver, a test defines the functions it calls
+
+#include <driver/gpio.h>
+
+typedef enum
+{
+	SPI1_HOST,
+	SPI2_HOST,
+	SPI3_HOST,
+} spi_host_device_t;
+
+typedef struct spi_device_t *spi_device_handle_t;
+
+struct spi_transaction_t
+{
+	uint32_t flags;
+	uint16_t cmd;
+	uint64_t addr;
+	size_t length;
+	size_t rxlength;
+	void *user;
+	union
+	{
+		const void *tx_buffer;
+		uint8_t tx_data[4];
+	};
+	union
+	{
+		void *rx_buffer;
+		uint8_t rx_data[4];
+	};
+};
+
+typedef void (*transaction_cb_t)(spi_transaction_t *);
+
+struct spi_device_interface_config_t
+{
+	uint8_t command_bits;
+	uint8_t address_bits;
+	uint8_t dummy_bits;
+	uint8_t mode;
+	uint16_t duty_cycle_pos;
+	uint16_t cs_ena_pretrans;
+	uint8_t cs_ena_posttrans;
+	int clock_speed_hz;
+	int input_delay_ns;
+	int spics_io_num;
+	uint32_t flags;
+	int queue_size;
+	transaction_cb_t pre_cb;
+	transaction_cb_t post_cb;
+};
+
+#define SPI_TRANS_USE_RXDATA (1 << 2)
+#define SPI_TRANS_USE_TXDATA (1 << 3)
+#define SPI_DEVICE_HALFDUPLEX (1 << 4)
+#define SPI_DEVICE_NO_DUMMY (1 << 6)
+
+#define SPI_SWAP_DATA_RX(data, len) (__builtin_bswap32(data) >> (32 - (len)))
+#define SPI_SWAP_DATA_TX(data, len) __builtin_bswap32((uint32_t)(data) << (32 - (len)))
+
+esp_err_t spi_bus_add_device(spi_host_device_t, const spi_device_interface_config_t *, spi_device_handle_t *);
+esp_err_t spi_bus_remove_device(spi_device_handle_t);
+esp_err_t spi_device_acquire_bus(spi_device_handle_t, TickType_t);
+void spi_device_release_bus(spi_device_handle_t);
+esp_err_t spi_device_polling_start(spi_device_handle_t, spi_transaction_t *, TickType_t);
+esp_err_t spi_device_polling_end(spi_device_handle_t, TickType_t);
+esp_err_t spi_device_queue_trans(spi_device_handle_t, spi_transaction_t *, TickType_t);
+esp_err_t spi_device_get_trans_result(spi_device_handle_t, spi_transaction_t **, TickType_t);
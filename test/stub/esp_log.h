@@ -0,0 +1,13 @@
+#pragma once
+// Host stub of the ESP-IDF logging, warnings and errors go to stderr, the rest is dropped
+
+#include <cinttypes>
+#include <cstdio>
+
+#define ESP_LOG_VERBOSE 5
+
+#define ESP_LOGE(tag, fmt, ...) fprintf(stderr, "E %s: " fmt "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGW(tag, fmt, ...) fprintf(stderr, "W %s: " fmt "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGI(tag, fmt, ...) ((void)(tag))
+#define ESP_LOGD(tag, fmt, ...) ((void)(tag))
+#define ESP_LOGV(tag, fmt, ...) ((void)(tag))
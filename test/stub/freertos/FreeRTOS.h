@@ -0,0 +1,13 @@
+#pragma once
+// Host stub of the FreeRTOS types the driver headers use
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned UBaseType_t;
+
+#define portMAX_DELAY 0xffffffffu
+#define BIT(n) (1u << (n))
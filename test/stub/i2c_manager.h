@@ -0,0 +1,14 @@
+#pragma once
+// Host stub of the i2c_manager component, declarations only
+
+#include <freertos/FreeRTOS.h>
+#include <esp_err.h>
+
+typedef enum
+{
+	I2C_NUM_0,
+	I2C_NUM_1,
+} i2c_port_t;
+
+esp_err_t i2c_manager_read(i2c_port_t, uint16_t, uint32_t, uint8_t *, uint16_t);
+esp_err_t i2c_manager_write(i2c_port_t, uint16_t, uint32_t, const uint8_t *, uint16_t);
@@ -0,0 +1,97 @@
+// bin_to_phy_nominal() against the conversion it replaced, which looked the range up per sample:
+// every 12-bit code, on every input and range, for the float (AIRDF), milli (AIRDM) and micro (AIRDU) outputs.
+// Floats must be bit-identical; integers must equal the old expression evaluated without int32 overflow.
+
+#include <cstdio>
+#include <cstring>
+
+#include "Conversion.h"
+
+using namespace Board;
+
+namespace
+{
+	size_t failures = 0;
+	size_t cases = 0;
+	size_t overflowed = 0; // where the old int32 expression overflowed, compared to its exact value
+
+	// The old bin_to_phy(), float output
+	float old_float(Input in, AnIn_Range rng, int32_t sum, int32_t cnt)
+	{
+		constexpr float ratio = u_ref / halfrangein;
+		size_t rngidx = static_cast<size_t>(rng);
+		if (in == Input::In4)
+			return sum * ratio / curr_gains[rngidx] / cnt * ItoU_input;
+		return sum * ratio * volt_divs[rngidx] / cnt;
+	}
+
+	// The old bin_to_phy(), integer outputs, in 64 bits; notes when the int32 original would have overflowed
+	template <int32_t mul>
+	int64_t old_int(Input in, AnIn_Range rng, int32_t sum, int32_t cnt, bool &ovf)
+	{
+		constexpr int32_t ratio = u_ref * mul / halfrangein;
+		size_t rngidx = static_cast<size_t>(rng);
+		auto fits = [](int64_t v)
+		{ return v == static_cast<int32_t>(v); };
+
+		int64_t val = int64_t(sum) * ratio;
+		ovf = !fits(val);
+		if (in == Input::In4)
+			return val / curr_gains[rngidx] / cnt * ItoU_input;
+		val *= volt_divs[rngidx];
+		ovf |= !fits(val);
+		return val / cnt;
+	}
+
+	void check(Input in, AnIn_Range rng, int32_t sum, int32_t cnt)
+	{
+		++cases;
+
+		float f_old = old_float(in, rng, sum, cnt);
+		float f_new = bin_to_phy_nominal<float>(in, rng, sum, cnt);
+		if (std::memcmp(&f_old, &f_new, sizeof(float)) != 0)
+		{
+			if (failures++ < 20)
+				printf("FAIL float in %u rng %u sum %" PRIi32 " cnt %" PRIi32 ": %.9g, was %.9g\n", unsigned(in), unsigned(rng), sum, cnt, f_new, f_old);
+		}
+
+		bool ovf_m, ovf_u;
+		int64_t m_old = old_int<1'000>(in, rng, sum, cnt, ovf_m);
+		int64_t u_old = old_int<1'000'000>(in, rng, sum, cnt, ovf_u);
+		int32_t m_new = bin_to_phy_nominal<int32_t, 1'000>(in, rng, sum, cnt);
+		int32_t u_new = bin_to_phy_nominal<int32_t, 1'000'000>(in, rng, sum, cnt);
+		overflowed += ovf_m + ovf_u;
+
+		if (m_new != m_old || u_new != u_old)
+		{
+			if (failures++ < 20)
+				printf("FAIL int in %u rng %u sum %" PRIi32 " cnt %" PRIi32 ": %" PRIi32 " mV %" PRIi32 " uV, was %" PRIi64 ", %" PRIi64 "\n",
+					   unsigned(in), unsigned(rng), sum, cnt, m_new, u_new, m_old, u_old);
+		}
+	}
+}
+
+int main()
+{
+	// repetition counts: single reads, small and large averages, and the AIRDC fraction
+	static constexpr int32_t cnts[] = {1, 2, 3, 7, 16, 100, 256, 1000, 4095};
+
+	for (size_t i = 1; i <= an_in_scale_num; ++i)
+		for (size_t r = 0; r < an_in_rng_num; ++r)
+			for (uint32_t code = 0; code <= MCP3204::max; ++code)
+			{
+				Input in = static_cast<Input>(i);
+				AnIn_Range rng = static_cast<AnIn_Range>(r);
+				int32_t val = static_cast<int32_t>(code) - halfrangein;
+
+				for (int32_t cnt : cnts)
+				{
+					check(in, rng, val * cnt, cnt); // every reading the same
+					if (cnt > 1 && code < MCP3204::max)
+						check(in, rng, val * cnt + cnt / 2, cnt); // a sum that does not divide
+				}
+			}
+
+	printf("test_conversion: %zu cases, %zu int32 overflows of the old path, %zu failures\n", cases, overflowed, failures);
+	return failures ? 1 : 0;
+}
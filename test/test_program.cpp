@@ -0,0 +1,193 @@
+// Round trip of the program upload formats: text -> Program::parse -> encode -> Program::load must give the same
+// program, fetched the same way, and a binary with a bad CRC or cut short anywhere must be rejected.
+// Also the stop requests the executor polls through Program.
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "Interpreter.h"
+
+using namespace Interpreter;
+
+namespace
+{
+	size_t failures = 0;
+
+#define CHECK(cond, ...)                                      \
+	do                                                        \
+	{                                                         \
+		if (!(cond))                                          \
+		{                                                     \
+			printf("FAIL %s:%d: %s: ", __FILE__, __LINE__, #cond); \
+			printf(__VA_ARGS__);                              \
+			printf("\n");                                     \
+			++failures;                                       \
+		}                                                     \
+	} while (0)
+
+	constexpr const char *programs[] = {
+		"AIEN; AIRDF 1 1; AIDIS;",
+		"AIRNG 2 MED; AIEN; LOOP 10; AIRDF 2 4; AIRDM 3 2; AIRDU 4 1; DELAY 100; END; AIDIS;",
+		"LOOP 3; AIRDB 0xF 8; AIRDC 1 16 3; DIRD; GETTM; END; RSTTM;",
+		"AOVAL 1 1.25; AOVAL 2 -0.5; AOGEN 1 0; AODUAL 0 1;",
+		"DOWR 0xA; DOSET 1; DORST 2; DOAND 0xC; DOXOR 3; DOMSK 12 3;",
+		"LOOP 5; AOSTEP 1 0.5 0.25; DELAYSTEP 10 1.5; LOOP 2; AOSTEP 2 -1 0.125; DELAY 7; END; END;",
+		"LOOP 0; DOSET 1; END; LOOP 1000; LOOP 2; AIRDF 1 1; END; DOXOR 1; END;",
+	};
+
+	// Reads bin in chunks of chunk bytes, at most limit of them
+	ReadCb reader(const std::string &bin, size_t &off, size_t chunk, size_t limit)
+	{
+		off = 0;
+		return [&bin, &off, chunk, limit](char *buf, size_t len) -> int
+		{
+			size_t n = std::min({len, chunk, std::min(limit, bin.size()) - off});
+			std::memcpy(buf, bin.data() + off, n);
+			off += n;
+			return n;
+		};
+	}
+
+	bool same(const Instruction &a, const Instruction &b)
+	{
+		return a.opc == b.opc && a.port == b.port && a.arg.u == b.arg.u;
+	}
+
+	bool has_error(const std::vector<std::string> &err, const char *what)
+	{
+		for (const std::string &e : err)
+			if (e.find(what) != std::string::npos)
+				return true;
+		return false;
+	}
+
+	void round_trip(const char *text)
+	{
+		std::vector<std::string> err;
+		Program parsed;
+		CHECK(parsed.parse(text, err) && parsed.isValid(), "parse of \"%s\": %s", text, err.empty() ? "" : err.front().c_str());
+
+		std::string bin;
+		parsed.encode(bin);
+		CHECK(bin.size() >= bin_header_sz + bin_trailer_sz, "encoding of \"%s\" is %zu bytes", text, bin.size());
+
+		for (size_t chunk : {size_t(1), size_t(7), bin.size()})
+		{
+			size_t off;
+			Program loaded;
+			err.clear();
+			CHECK(loaded.load(reader(bin, off, chunk, bin.size()), bin.size(), err) && loaded.isValid(),
+				  "load of \"%s\" in chunks of %zu: %s", text, chunk, err.empty() ? "" : err.front().c_str());
+
+			// the same packed program
+			CHECK(loaded.size() == parsed.size() && loaded.loop_count() == parsed.loop_count(), "\"%s\": %zu instructions, %zu loops; loaded %zu, %zu",
+				  text, parsed.size(), parsed.loop_count(), loaded.size(), loaded.loop_count());
+			for (size_t i = 0; i < std::min(loaded.size(), parsed.size()); ++i)
+				CHECK(same(loaded.instructions()[i], parsed.instructions()[i]), "\"%s\": instruction %zu differs", text, i);
+
+			std::string again;
+			loaded.encode(again);
+			CHECK(again == bin, "\"%s\": re-encoding differs", text);
+
+			// the same behaviour: fetch order, loop iterations and step values
+			parsed.reset();
+			loaded.reset();
+			size_t fetched = 0;
+			while (true)
+			{
+				InstrPtr a = parsed.getInstr();
+				InstrPtr b = loaded.getInstr();
+				if (!a || !b)
+				{
+					CHECK(!a && !b, "\"%s\": one program ends after %zu fetches", text, fetched);
+					break;
+				}
+				CHECK(a->opc == b->opc && a->port == b->port, "\"%s\": fetch %zu differs", text, fetched);
+				if (a->opc == OPCode::AOSTEP || a->opc == OPCode::DELAYSTEP)
+					CHECK(parsed.step_value(*a) == loaded.step_value(*b), "\"%s\": step value at fetch %zu differs", text, fetched);
+				else
+					CHECK(a->arg.u == b->arg.u, "\"%s\": arg at fetch %zu differs", text, fetched);
+				++fetched;
+			}
+		}
+	}
+
+	void corrupted(const char *text)
+	{
+		std::vector<std::string> err;
+		Program parsed;
+		parsed.parse(text, err);
+		std::string bin;
+		parsed.encode(bin);
+
+		// a bit flipped in the CRC, and in the arg of the last record (DELAY, any value passes its checker)
+		for (size_t pos : {bin.size() - 1, bin.size() - bin_trailer_sz - 1})
+		{
+			std::string bad = bin;
+			bad[pos] ^= 0x10;
+
+			size_t off;
+			Program loaded;
+			err.clear();
+			CHECK(!loaded.load(reader(bad, off, 7, bad.size()), bad.size(), err) && !loaded.isValid(), "\"%s\": bit flipped at %zu loads", text, pos);
+			CHECK(has_error(err, "CRC mismatch!"), "\"%s\": bit flipped at %zu: %s", text, pos, err.empty() ? "no error" : err.front().c_str());
+		}
+
+		for (size_t len = 0; len < bin.size(); ++len)
+		{
+			size_t off;
+
+			// the declared size agrees with the data, which is short
+			Program cut;
+			err.clear();
+			CHECK(!cut.load(reader(bin, off, 7, len), len, err) && !cut.isValid(), "\"%s\": cut to %zu bytes loads", text, len);
+			CHECK(has_error(err, "truncated header!") || has_error(err, "size does not match instruction count!"),
+				  "\"%s\": cut to %zu bytes: %s", text, len, err.empty() ? "no error" : err.front().c_str());
+
+			// the declared size is right, the stream ends early
+			Program ended;
+			err.clear();
+			CHECK(!ended.load(reader(bin, off, 7, len), bin.size(), err) && !ended.isValid(), "\"%s\": stream ending at %zu loads", text, len);
+			CHECK(has_error(err, "truncated"), "\"%s\": stream ending at %zu: %s", text, len, err.empty() ? "no error" : err.front().c_str());
+		}
+	}
+
+	// A StopCb is asked at each loop back-edge and by poll_stop(), the program ends once it says so
+	void stopped()
+	{
+		static size_t asked;
+		std::vector<std::string> err;
+		Program prg;
+		prg.parse("DOSET 1; LOOP 10; AIRDF 1 1; DELAY 5; END; DORST 1;", err);
+
+		asked = 0;
+		prg.reset([]()
+				  { return ++asked == 3; });
+		size_t fetched = 0;
+		while (prg.getInstr())
+			++fetched;
+		CHECK(asked == 3 && fetched == 1 + 3 * 2, "stopped at back-edge %zu after %zu fetches", asked, fetched);
+
+		asked = 0;
+		prg.reset([]()
+				  { return true; });
+		CHECK(prg.getInstr() && prg.poll_stop() && !prg.getInstr(), "poll_stop() does not end the program");
+
+		prg.reset();
+		CHECK(!prg.poll_stop() && prg.getInstr(), "no StopCb stops the program");
+	}
+}
+
+int main()
+{
+	for (const char *text : programs)
+		round_trip(text);
+
+	corrupted("LOOP 4; AOSTEP 1 0 0.5; AIRDF 1 2; END; DELAY 250;");
+	stopped();
+
+	printf("test_program: %zu failures\n", failures);
+	return failures ? 1 : 0;
+}